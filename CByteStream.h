@@ -0,0 +1,245 @@
+#ifndef __CBYTESTREAM_H__
+#define __CBYTESTREAM_H__
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/chrono.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/**
+ * Byte stream interface of the device drivers (CGps, CPidScanner).
+ * Implemented by the serial port (CUart) and by sources that replay or
+ * relay data: memory-mapped log files, pipes/stdin and sockets, so the
+ * same driver code runs on live devices and recorded data.
+ */
+class CByteStream
+{
+public:
+    /**
+     * Possible outcome of a read.
+     */
+    enum ReadResult
+    {
+        resultInProgress,
+        resultSuccess,
+        resultError,
+        resultTimeoutExpired
+    };
+
+    /**
+     * Clock of receive timestamps, monotonic
+     */
+    typedef boost::chrono::steady_clock Clock;
+
+    virtual ~CByteStream() {}
+
+    /**
+     * \return true if stream is open
+     */
+    virtual bool isOpen() const = 0;
+
+    /**
+     * Close the stream
+     */
+    virtual void close() = 0;
+
+    /**
+     * Set the timeout on read operations.
+     * To disable the timeout, call setTimeout(boost::posix_time::seconds(0));
+     */
+    virtual void setTimeout(const boost::posix_time::time_duration& t) = 0;
+
+    /**
+     * Write data
+     * \param data array of char to be sent
+     * \param size array size
+     */
+    virtual void write(const char *data, size_t size) = 0;
+
+    /**
+     * Write a string
+     * \param s string to send
+     */
+    virtual void writeString(const std::string& s) = 0;
+
+    /**
+     * Write a line: string followed by line terminator
+     * \param s string to send
+     * \param eol line terminator
+     */
+    virtual void writeLine(const std::string& s, const std::string& eol)
+    {
+        write(s.data(), s.size());
+        write(eol.data(), eol.size());
+    }
+
+    /**
+     * Read a fixed amount of data, blocking
+     * \param data array of char to be read
+     * \param size array size
+     * \return status of type ReadResult
+     */
+    virtual int read(char *data, size_t size) = 0;
+
+    /**
+     * Read a string of out.capacity() characters, blocking
+     * \param [out] out string with the received data
+     * \return status of type ReadResult
+     */
+    virtual int readString(std::string &out)
+    {
+        if(out.size() < out.capacity()) out.resize(out.capacity());
+        return out.empty() ? resultSuccess : read(&out[0], out.size());
+    }
+
+    /**
+     * Read a line, blocking. Non-printables are removed.
+     * \param [out] out string the line is appended to, without delimiter
+     * \param [in] delim line delimiter
+     * \return status of type ReadResult
+     */
+    virtual int readStringUntil(std::string &out, const std::string& delim="\n") = 0;
+
+    /**
+     * Line filter of readFilteredLine()
+     */
+    class LineFilter
+    {
+    public:
+        virtual ~LineFilter() {}
+
+        /**
+         * \param data raw line in the receive buffer, without delimiter
+         * \param size line size
+         * \return true if the line is wanted
+         */
+        virtual bool accept(const char *data, size_t size) const = 0;
+    };
+
+    /**
+     * Read the next line accepted by a filter, blocking. Non-printables
+     * are removed. The filter sees each line where it was received, lines
+     * it rejects are discarded without being copied. The timeout covers
+     * the whole call, rejected lines included.
+     * This default copies each line first, streams with a receive buffer
+     * override it.
+     * \param [out] out string the line is appended to, without delimiter
+     * \param [in] delim line delimiter
+     * \param [in] filter line filter
+     * \param [out] skipped incremented for every rejected line
+     * \return status of type ReadResult
+     */
+    virtual int readFilteredLine(std::string &out, const std::string& delim,
+            const LineFilter& filter, size_t &skipped)
+    {
+        size_t start = out.size();
+        for(;;)
+        {
+            int rc = readStringUntil(out, delim);
+            if(rc != resultSuccess || filter.accept(out.data() + start, out.size() - start))
+            {
+                return rc;
+            }
+            out.resize(start);
+            skipped++;
+        }
+    }
+
+    /**
+     * Arrival time of the data returned by the last successful read: when
+     * the read that received its last byte completed. Lines that arrived
+     * together in one chunk share its time. Unlike the time a line is
+     * parsed, it does not include the time the line waited in buffers.
+     * \return receive time, Clock::time_point() before the first read
+     */
+    virtual Clock::time_point getReceiveTime() const = 0;
+
+protected:
+    /**
+    * Check if binary data in a character
+    */
+    static bool is_binary(char c)
+    {
+        if(c >= ' ' || c == '\n' || c == '\r')
+        {
+            return false;
+        }
+        return true;
+    };
+
+    /**
+     * \return length of leading run of non-binary characters
+     */
+    static size_t printableRun(const char *p, size_t size)
+    {
+        const boost::uint64_t ones=0x0101010101010101ULL;
+        const boost::uint64_t highs=0x8080808080808080ULL;
+        size_t pos=0;
+        // Word at a time while all 8 bytes are surely printable: no byte
+        // below ' ' and none with high bit set (see is_binary)
+        for(boost::uint64_t v; pos+sizeof(v)<=size; pos+=sizeof(v))
+        {
+            memcpy(&v,p+pos,sizeof(v));
+            if((((v-ones*' ')&~v)|v)&highs) break;
+        }
+        while(pos<size && !is_binary(p[pos])) pos++;
+        return pos;
+    }
+
+    /**
+     * Append p to string, removing non-printables
+     */
+    static void appendPrintable(std::string &out, const char *p, size_t size)
+    {
+        while(size>0)
+        {
+            size_t run=printableRun(p,size);
+            out.append(p,run);
+            if(run<size) run++;//Skip binary character
+            p+=run;
+            size-=run;
+        }
+    }
+
+    /**
+     * Copy p to buffer, removing non-printables
+     * \return number of bytes copied
+     */
+    static size_t copyPrintable(char *data, size_t capacity, const char *p,
+            size_t size)
+    {
+        size_t len=0;
+        while(size>0 && len<capacity)
+        {
+            size_t run=std::min(printableRun(p,size),capacity-len);
+            memcpy(data+len,p,run);
+            len+=run;
+            if(run<size && is_binary(p[run])) run++;//Skip binary character
+            p+=run;
+            size-=run;
+        }
+        return len;
+    }
+
+    /**
+     * Find delimiter in p
+     * \return position of the delimiter, null if not found
+     */
+    static const char *findDelim(const char *p, size_t size,
+            const std::string& delim)
+    {
+        const char *end=p+size;
+        while(static_cast<size_t>(end-p)>=delim.size())
+        {
+            p=static_cast<const char*>(memchr(p,delim[0],end-p-delim.size()+1));
+            if(!p) return 0;
+            if(memcmp(p+1,delim.data()+1,delim.size()-1)==0) return p;
+            p++;
+        }
+        return 0;
+    }
+};
+
+#endif // __CBYTESTREAM_H__
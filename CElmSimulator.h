@@ -0,0 +1,354 @@
+#ifndef __CELMSIMULATOR_H__
+#define __CELMSIMULATOR_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+
+#include "CPtyLoopback.h"
+
+// --------------------------------------------
+/// ELM327 simulator, the device side of CPidScanner on a CPtyLoopback
+/// responder. Answers the AT commands CPidScanner sends and Mode 01
+/// requests from a table of PID values, including multi-PID requests and
+/// PIDs answered by several ECUs, as an ELM327 v1.5 on a CAN or on a
+/// legacy (ISO 9141 / KWP) vehicle does. The bus is modelled by timing
+/// only: each request costs the ECU response time plus the time the
+/// adapter waits for further responses before printing the prompt,
+/// unless the request says how many responses to expect and they came.
+/// That wait follows the adapter timing: with the defaults (ATAT1, ATST32)
+/// it is the wait given to the constructor, ATST bounds it, ATAT2 halves
+/// it and ATAT0 waits the full ATST time. An ECU slower than an explicit
+/// ATST time is missed. Responses are printed with spaces between the
+/// bytes unless ATS0; ATH0 and ATCAF1, the defaults, are acknowledged.
+class CElmSimulator
+{
+public:
+    /// ELM protocol numbers, see ATSP / ATDPN
+    enum Protocol
+    {
+        PROTOCOL_ISO_9141   = 3,
+        PROTOCOL_CAN_11_500 = 6
+    };
+
+    /// Request counters, see getCounts()
+    struct Counts
+    {
+        size_t requests;    ///< OBD requests sent to the bus
+        size_t bytesOut;    ///< bytes sent to the host
+    };
+
+    /**
+    * \param protocol vehicle protocol, see Protocol
+    * \param ecu_us ECU response time, usec
+    * \param wait_us time the adapter waits for more responses after the
+    *  last one with its default timing, usec
+    */
+    explicit CElmSimulator(int protocol = PROTOCOL_CAN_11_500, unsigned ecu_us = 5000, unsigned wait_us = 50000) :
+        m_protocol(protocol), m_ecu_us(ecu_us), m_wait_us(wait_us), m_echo(true), m_spaces(true), m_adaptive(1), m_st_us(0)
+    {
+        m_counts.requests = m_counts.bytesOut = 0;
+        // engine warm, idling at 1726 rpm on the way at 50 km/h
+        setPid(0x04, "80");
+        setPid(0x05, "7B");
+        setPid(0x0C, "1AF8");
+        setPid(0x0D, "32", 2);  // ABS module reports speed too
+        setPid(0x11, "40");
+        setPid(0x2F, "80");
+        setPid(0x42, "3030");
+    };
+
+    /**
+    * Set the value of a Mode 01 PID
+    * \param pid PID
+    * \param hex data bytes, e.g. "1AF8"
+    * \param ecus number of ECUs that answer it, up to 2
+    */
+    void setPid(int pid, const std::string & hex, int ecus = 1)
+    {
+        m_pids[pid].hex = hex;
+        m_pids[pid].ecus = ecus;
+    };
+
+    /// Change the ECU response time, e.g. while the responder runs
+    void setEcuTime(unsigned ecu_us) { m_ecu_us = ecu_us; };
+
+    /// \return responder for CPtyLoopback::startResponder()
+    CPtyLoopback::Responder responder()
+    {
+        return boost::bind(&CElmSimulator::reply, this, _1);
+    };
+
+    /// \return counters since construction, read after the responder stopped
+    const Counts & getCounts() const { return m_counts; };
+
+    /**
+    * Reply to a request
+    * \param request command, delimiter removed
+    * \return reply, prompt included
+    */
+    std::string reply(const std::string & request)
+    {
+        std::string cmd;
+        for(size_t i = 0; i < request.size(); i++)
+        {
+            if(request[i] != ' ')
+            {
+                cmd += static_cast<char>(toupper(static_cast<unsigned char>(request[i])));
+            }
+        }
+        std::string out = m_echo ? request + "\r" : std::string();
+        if(cmd.compare(0, 2, "AT") == 0)
+        {
+            out += command(cmd.substr(2));
+        }
+        else
+        {
+            out += obdRequest(cmd);
+        }
+        out += "\r>";
+        m_counts.bytesOut += out.size();
+        return out;
+    };
+
+private:
+    /// AT command reply, without prompt
+    std::string command(const std::string & cmd)
+    {
+        if(cmd == "Z")
+        {
+            m_echo = true;
+            m_spaces = true;
+            m_adaptive = 1;
+            m_st_us = 0;
+            usleep(ATZ_US);
+            return "\rELM327 v1.5\r";
+        }
+        if(cmd == "I")
+        {
+            return "ELM327 v1.5\r";
+        }
+        if(cmd == "E0" || cmd == "E1")
+        {
+            m_echo = cmd[1] == '1';
+            return "OK\r";
+        }
+        if(cmd == "L0" || cmd == "L1" || cmd == "H0" || cmd == "CAF1")
+        {
+            return "OK\r";
+        }
+        if(cmd == "S0" || cmd == "S1")
+        {
+            m_spaces = cmd[1] == '1';
+            return "OK\r";
+        }
+        if(cmd == "AT0" || cmd == "AT1" || cmd == "AT2")
+        {
+            m_adaptive = cmd[2] - '0';
+            return "OK\r";
+        }
+        if(cmd.size() == 4 && cmd.compare(0, 2, "ST") == 0 && isHex(cmd.substr(2)))
+        {
+            unsigned st = strtoul(cmd.substr(2).c_str(), NULL, 16);
+            // 0 restores the default
+            m_st_us = (st == 0 || st == ST_DEFAULT) ? 0 : st * 4000;
+            return "OK\r";
+        }
+        if(cmd == "DPN")
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "A%X\r", m_protocol);
+            return buf;
+        }
+        return "?\r";
+    };
+
+    /// OBD request reply, without prompt
+    std::string obdRequest(const std::string & cmd)
+    {
+        if(cmd.size() < 4 || !isHex(cmd) || cmd.compare(0, 2, "01") != 0)
+        {
+            return "?\r";
+        }
+        m_counts.requests++;
+
+        // odd length: expected number of responses appended
+        size_t expected = 0;
+        size_t count = (cmd.size() - 2) / 2;
+        if(cmd.size() % 2)
+        {
+            expected = strtoul(cmd.substr(cmd.size() - 1).c_str(), NULL, 16);
+        }
+        unsigned wait_us = timeout();
+        if(count > MAX_PIDS_PER_REQUEST || (count > 1 && !isCan()))
+        {
+            // legacy ECUs ignore requests for more than one PID
+            usleep(wait_us);
+            return "NO DATA\r";
+        }
+        unsigned ecu_us = m_ecu_us;
+        if(m_st_us && ecu_us > m_st_us)
+        {
+            // gave up before the ECU answered
+            usleep(m_st_us);
+            return "NO DATA\r";
+        }
+
+        // one message per answering ECU, with the PIDs it knows
+        std::string out;
+        size_t messages = 0;
+        for(int ecu = 0; expected == 0 || messages < expected; ecu++)
+        {
+            std::vector<unsigned char> data(1, 0x41);
+            for(size_t i = 0; i < count; i++)
+            {
+                int pid = static_cast<int>(strtoul(cmd.substr(2 + 2 * i, 2).c_str(), NULL, 16));
+                std::string value;
+                if(pid == 0x00)
+                {
+                    if(ecu >= ECUS)
+                    {
+                        continue;
+                    }
+                    value = supportedPids();
+                }
+                else if(m_pids.count(pid) && ecu < m_pids[pid].ecus)
+                {
+                    value = m_pids[pid].hex;
+                }
+                else
+                {
+                    continue;
+                }
+                data.push_back(static_cast<unsigned char>(pid));
+                for(size_t k = 0; k + 1 < value.size(); k += 2)
+                {
+                    data.push_back(static_cast<unsigned char>(strtoul(value.substr(k, 2).c_str(), NULL, 16)));
+                }
+            }
+            if(data.size() == 1)
+            {
+                break;
+            }
+            out += format(data);
+            messages++;
+        }
+        // the prompt comes at once if all expected responses came
+        if(!messages)
+        {
+            usleep(wait_us);
+            return "NO DATA\r";
+        }
+        usleep(ecu_us + ((expected && messages >= expected) ? 0 : wait_us));
+        return out;
+    };
+
+    /// Response as printed with headers off: one line, or the
+    /// ISO 15765-2 frames of a CAN response over 7 bytes
+    std::string format(const std::vector<unsigned char> & data) const
+    {
+        char buf[8];
+        std::string out;
+        if(data.size() <= 7)
+        {
+            for(size_t i = 0; i < data.size(); i++)
+            {
+                snprintf(buf, sizeof(buf), m_spaces ? "%02X " : "%02X", data[i]);
+                out += buf;
+            }
+            return out + "\r";
+        }
+        snprintf(buf, sizeof(buf), "%03X\r", static_cast<unsigned>(data.size()));
+        out = buf;
+        // first frame carries 6 data bytes, consecutive frames 7, padded
+        for(size_t i = 0, frame = 0; i < data.size(); frame++)
+        {
+            snprintf(buf, sizeof(buf), "%X:", static_cast<unsigned>(frame & 0x0F));
+            out += buf;
+            size_t n = frame ? 7 : 6;
+            for(size_t k = 0; k < n; k++, i++)
+            {
+                snprintf(buf, sizeof(buf), m_spaces ? " %02X" : "%02X", i < data.size() ? data[i] : 0);
+                out += buf;
+            }
+            out += "\r";
+        }
+        return out;
+    };
+
+    /// PIDs 01-20 supported bitmap of PID 00
+    std::string supportedPids() const
+    {
+        unsigned long mask = 0;
+        for(std::map<int, Pid>::const_iterator it = m_pids.begin(); it != m_pids.end(); ++it)
+        {
+            if(it->first >= 0x01 && it->first <= 0x20 && it->second.ecus > 0)
+            {
+                mask |= 1UL << (32 - it->first);
+            }
+        }
+        char buf[12];
+        snprintf(buf, sizeof(buf), "%08lX", mask);
+        return buf;
+    };
+
+    /// Wait for responses with the current timing, usec
+    unsigned timeout() const
+    {
+        unsigned st_us = m_st_us ? m_st_us : ST_DEFAULT * 4000;
+        switch(m_adaptive)
+        {
+        case 0:  return st_us;
+        case 2:  return std::min(st_us, m_wait_us / 2);
+        default: return std::min(st_us, m_wait_us);
+        }
+    };
+
+    bool isCan() const { return m_protocol >= 6 && m_protocol <= 0x0C; };
+
+    static bool isHex(const std::string & s)
+    {
+        for(size_t i = 0; i < s.size(); i++)
+        {
+            if(!isxdigit(static_cast<unsigned char>(s[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    enum
+    {
+        MAX_PIDS_PER_REQUEST = 6,
+        ECUS = 2,               ///< ECUs on the bus, all answer PID 00
+        ATZ_US = 1000,          ///< reset time
+        ST_DEFAULT = 0x32       ///< default ATST, 4 ms units
+    };
+
+    /// Value of a PID
+    struct Pid
+    {
+        std::string hex;    ///< data bytes
+        int ecus;           ///< number of ECUs that answer
+    };
+
+    int m_protocol;
+    boost::atomic<unsigned> m_ecu_us;
+    unsigned m_wait_us;
+    bool m_echo;
+    bool m_spaces;          ///< ATS1
+    int m_adaptive;         ///< ATAT mode
+    unsigned m_st_us;       ///< ATST time, 0 - default
+    std::map<int, Pid> m_pids;  ///< Mode 01 PID values
+    Counts m_counts;
+};
+
+#endif // __CELMSIMULATOR_H__
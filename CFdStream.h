@@ -0,0 +1,284 @@
+#ifndef __CFDSTREAM_H__
+#define __CFDSTREAM_H__
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <boost/utility.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "CByteStream.h"
+
+// --------------------------------------------
+/// Byte stream over a POSIX file descriptor: stdin, a pipe or FIFO, or
+/// a connected socket (see CSocketStream). Reads wait with poll() for the
+/// timeout and go through a receive buffer, lines are extracted from it
+/// in bulk as in CUart.
+class CFdStream : public CByteStream, private boost::noncopyable
+{
+public:
+    /**
+    * \param fd descriptor to use, e.g. STDIN_FILENO; -1 - not open
+    * \param own true to close the descriptor in close()
+    */
+    explicit CFdStream(int fd = -1, bool own = false) :
+        m_fd(fd), m_own(own), m_eof(false), m_timeout_ms(-1), m_begin(0), m_end(0),
+        m_buf(RX_BUFFER_SIZE) {};
+
+    virtual ~CFdStream() { close(); };
+
+    /**
+    * Open a FIFO or a regular file for reading
+    * \param path file name
+    * \return true if OK
+    */
+    bool open(const std::string & path)
+    {
+        close();
+        m_fd = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+        if(m_fd < 0)
+        {
+            m_fd = ::open(path.c_str(), O_RDONLY | O_NOCTTY);
+        }
+        m_own = true;
+        return m_fd >= 0;
+    };
+
+    /**
+    * Use an already open descriptor
+    * \param fd descriptor
+    * \param own true to close the descriptor in close()
+    */
+    void attach(int fd, bool own = false)
+    {
+        CFdStream::close();
+        m_fd = fd;
+        m_own = own;
+    };
+
+    virtual bool isOpen() const { return m_fd >= 0; };
+
+    virtual void close()
+    {
+        if(m_fd >= 0 && m_own)
+        {
+            ::close(m_fd);
+        }
+        m_fd = -1;
+        m_eof = false;
+        m_begin = m_end = 0;
+    };
+
+    virtual void setTimeout(const boost::posix_time::time_duration& t)
+    {
+        m_timeout_ms = (t == boost::posix_time::milliseconds(0)) ? -1 : t.total_milliseconds();
+    };
+
+    /**
+    * Write all data, also the part a short write left
+    * \throws boost::system::system_error if any error
+    */
+    virtual void write(const char *data, size_t size)
+    {
+        while(size > 0 && m_fd >= 0)
+        {
+            ssize_t rc = ::write(m_fd, data, size);
+            if(rc < 0)
+            {
+                if(errno == EINTR) continue;
+                throw boost::system::system_error(errno, boost::system::system_category());
+            }
+            data += rc;
+            size -= rc;
+        }
+    };
+
+    virtual void writeString(const std::string& s) { write(s.data(), s.size()); };
+
+    virtual int read(char *data, size_t size)
+    {
+        boost::posix_time::ptime deadline = readDeadline();
+        while(m_end - m_begin < size)
+        {
+            int rc = fill(deadline);
+            if(rc != resultSuccess)
+            {
+                return rc;
+            }
+        }
+        memcpy(data, &m_buf[m_begin], size);
+        m_begin += size;
+        m_readTime = m_rxTime;
+        return resultSuccess;
+    };
+
+    virtual int readStringUntil(std::string &out, const std::string& delim="\n")
+    {
+        size_t len;
+        int rc = waitLine(readDeadline(), delim, len);
+        if(rc == resultSuccess)
+        {
+            appendPrintable(out, &m_buf[m_begin], len);
+            m_begin += len + delim.size();
+            m_readTime = m_rxTime;
+        }
+        return rc;
+    };
+
+    virtual int readFilteredLine(std::string &out, const std::string& delim,
+            const LineFilter& filter, size_t &skipped)
+    {
+        boost::posix_time::ptime deadline = readDeadline();
+        for(;;)
+        {
+            size_t len;
+            int rc = waitLine(deadline, delim, len);
+            if(rc != resultSuccess)
+            {
+                return rc;
+            }
+            bool wanted = filter.accept(&m_buf[m_begin], len);
+            if(wanted)
+            {
+                appendPrintable(out, &m_buf[m_begin], len);
+            }
+            m_begin += len + delim.size();
+            if(wanted)
+            {
+                m_readTime = m_rxTime;
+                return resultSuccess;
+            }
+            skipped++;
+        }
+    };
+
+    /// Data waits in the receive buffer only until it is asked for, so
+    /// whatever is returned arrived with the newest chunk at the latest
+    virtual Clock::time_point getReceiveTime() const { return m_readTime; };
+
+    /// \return true if the other end closed the stream
+    bool eof() const { return m_eof && m_begin == m_end; };
+
+    /// \return descriptor
+    int getFd() const { return m_fd; };
+
+protected:
+    enum { RX_BUFFER_SIZE = 64 * 1024 };
+
+    /**
+    * Wait until a complete line is at the start of the receive buffer
+    * \param [out] len line length, without delimiter
+    * \return status of type ReadResult
+    */
+    int waitLine(const boost::posix_time::ptime & deadline, const std::string& delim, size_t &len)
+    {
+        size_t scan = m_begin;
+        for(;;)
+        {
+            const char *pos = findDelim(&m_buf[scan], m_end - scan, delim);
+            if(pos)
+            {
+                len = pos - &m_buf[m_begin];
+                return resultSuccess;
+            }
+            // next search restarts where a partial delimiter may begin
+            if(m_end - m_begin >= delim.size())
+            {
+                scan = m_end - delim.size() + 1;
+            }
+            size_t scanned = scan - m_begin;
+            int rc = fill(deadline);
+            if(rc != resultSuccess)
+            {
+                return rc;
+            }
+            scan = m_begin + scanned;
+        }
+    };
+
+    /**
+    * Wait for data until deadline and append it to the receive buffer
+    * \return status of type ReadResult
+    */
+    int fill(const boost::posix_time::ptime & deadline)
+    {
+        if(m_fd < 0 || m_eof)
+        {
+            return resultError;
+        }
+        // compact, then grow if a line does not fit
+        if(m_begin > 0)
+        {
+            memmove(&m_buf[0], &m_buf[m_begin], m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if(m_end == m_buf.size())
+        {
+            m_buf.resize(m_buf.size() * 2);
+        }
+
+        for(;;)
+        {
+            int wait_ms = -1;
+            if(!deadline.is_pos_infinity())
+            {
+                boost::posix_time::time_duration left = deadline - boost::posix_time::microsec_clock::universal_time();
+                wait_ms = left.is_negative() ? 0 : left.total_milliseconds();
+            }
+            struct pollfd pfd = { m_fd, POLLIN, 0 };
+            int rc = poll(&pfd, 1, wait_ms);
+            if(rc < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(rc == 0)
+            {
+                return resultTimeoutExpired;
+            }
+            if(rc < 0)
+            {
+                return resultError;
+            }
+            ssize_t n = ::read(m_fd, &m_buf[m_end], m_buf.size() - m_end);
+            if(n < 0 && (errno == EINTR || errno == EAGAIN))
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                m_eof = true;
+                return resultError;
+            }
+            m_end += n;
+            m_rxTime = Clock::now();
+            return resultSuccess;
+        }
+    };
+
+    /// Absolute deadline of a read from the timeout
+    boost::posix_time::ptime readDeadline() const
+    {
+        if(m_timeout_ms < 0)
+        {
+            return boost::posix_time::ptime(boost::posix_time::pos_infin);
+        }
+        return boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(m_timeout_ms);
+    };
+
+    int m_fd;
+    bool m_own;
+    bool m_eof;
+    long m_timeout_ms;
+    size_t m_begin; ///< start of unread data in m_buf
+    size_t m_end; ///< end of data in m_buf
+    std::vector<char> m_buf;
+    Clock::time_point m_rxTime; ///< arrival of the newest data in m_buf
+    Clock::time_point m_readTime; ///< arrival of the data of the last read
+};
+
+#endif // __CFDSTREAM_H__
@@ -3,11 +3,17 @@
 #define __CGPS_H__
 
 #include <map>
+#include <cmath>
 #include <string>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/chrono.hpp>
 
 #include "CSerialPort.h"
+#include "CNmeaSentence.h"
+#include "CGpsFix.h"
+#include "CGpsTrack.h"
+#include "CUbx.h"
 #include "CRecurrent.h"
 
 using namespace std;
@@ -18,12 +24,26 @@ using namespace boost;
 class CGps : public CRecurrent
 {
 public:
-    CGps(CUart & port = *(CUart*)NULL, int poll_interval = 1) : 
+    CGps(CByteStream & port = *(CByteStream*)NULL, int poll_interval = 1) : 
 	  CRecurrent(poll_interval), 
 	  m_reads(0),
 	  m_bearing("NO_BEARINGS_YET"),
+	  m_formatted(true),
+	  m_written(0),
+	  m_trackTime(NO_TIME),
+	  m_epoch(0),
 	  m_port(port), 
-	  m_initialized(false)  {};
+	  m_delim("\r\n"),
+	  m_skipped(0),
+	  m_protocol(PROTOCOL_NMEA),
+	  m_drainBudget(0),
+	  m_initialized(false)
+    {
+        std::fill(m_inView, m_inView + TALKER_COUNT, 0);
+        std::fill(m_inViewEpoch, m_inViewEpoch + TALKER_COUNT, 0);
+        m_lastDrain.processed = m_lastDrain.dropped = 0;
+        m_drainTotal = m_lastDrain;
+    };
    
     virtual ~CGps() { if (&m_port) m_port.close(); };
 
@@ -38,6 +58,56 @@ public:
         return 0;
    };
 
+   /// Receiver output protocol
+   enum Protocol
+   {
+       PROTOCOL_NMEA, ///< NMEA 0183 sentences
+       PROTOCOL_UBX   ///< u-blox UBX NAV-PVT messages
+   };
+
+   /**
+   * Switch a u-blox receiver to UBX NAV-PVT output at a navigation rate,
+   * the port keeps accepting both protocols. Reads are switched to UBX.
+   * \param baud current port speed, the receiver needs it in CFG-PRT
+   * \param rate_hz navigation rate, 1..25 Hz depending on the receiver
+   * \return 0 - OK, 1 - no acknowledge, 2 - command rejected
+   */
+   int enableUbx(boost::uint32_t baud, int rate_hz)
+   {
+        const std::string commands[] =
+        {
+            CUbx::cfgPort(baud, CUbx::PROTO_UBX | CUbx::PROTO_NMEA, CUbx::PROTO_UBX),
+            CUbx::cfgMessage(CUbx::CLASS_NAV, CUbx::NAV_PVT, 1),
+            CUbx::cfgRate(static_cast<boost::uint16_t>(1000 / (rate_hz > 0 ? rate_hz : 1)))
+        };
+        for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        {
+            m_port.writeString(commands[i]);
+            int rc = waitAck(static_cast<unsigned char>(commands[i][2]), static_cast<unsigned char>(commands[i][3]));
+            if(rc)
+            {
+                return rc;
+            }
+        }
+        m_protocol = PROTOCOL_UBX;
+        return 0;
+   };
+
+   /**
+   * Select the protocol read by pollBearing() and Poll()
+   */
+   void setProtocol(Protocol protocol)
+   {
+        m_protocol = protocol;
+   };
+
+   /// Sentence counts of drained polls
+   struct DrainCounts
+   {
+       size_t processed; ///< sentences parsed
+       size_t dropped;   ///< sentences superseded by a newer one of the same address
+   };
+
    /**
    * Polls with interval "poll_interval"
    * \return 0 - OK, otherwise - error
@@ -46,7 +116,7 @@ public:
    {
       if(isPollTime())
       {
-        if(pollBearing())
+        if((m_drainBudget > 0 && m_protocol == PROTOCOL_NMEA) ? drainSentences() : pollBearing())
         {
             return 1;
         }
@@ -55,6 +125,70 @@ public:
       return 0;
    };
 
+   /**
+   * Set delimiter of NMEA sentences, "\r\n" by default.
+   * Recorded logs may use "\n" only.
+   * \param delim sentence delimiter
+   */
+   void setSentenceDelimiter(const std::string & delim)
+   {
+        m_delim = delim;
+   };
+
+   /**
+   * Make Poll() read every sentence already received instead of one.
+   * Sentences are read until none is pending or the budget is spent, and
+   * only the newest of each address (talker and type) is parsed, so the fix
+   * stays within one epoch of the receiver at any output rate. The wait for
+   * the first sentence is within the budget too.
+   * \param budget_ms time budget of one Poll(), msec, 0 - one sentence per Poll()
+   */
+   void setDrainBudget(int budget_ms)
+   {
+        m_drainBudget = budget_ms;
+   };
+
+   /**
+   * Read only the given sentence types, of any talker. Other lines are
+   * discarded in the receive buffer of the stream, by their header, and
+   * never copied or parsed.
+   * \param types comma separated 3-letter types, e.g. "RMC,GGA";
+   *  empty - all sentences
+   */
+   void setSentenceFilter(const std::string & types)
+   {
+        m_filter.clear();
+        size_t pos = 0;
+        while(pos + 3 <= types.size())
+        {
+            m_filter.add(sentenceType(types[pos], types[pos + 1], types[pos + 2]));
+            size_t comma = types.find(',', pos);
+            if(comma == std::string::npos)
+            {
+                break;
+            }
+            pos = comma + 1;
+        }
+   };
+
+   /// \return number of lines discarded by the sentence filter
+   size_t getSkippedCount() const
+   {
+        return m_skipped;
+   };
+
+   /// \return sentence counts of the last drained Poll()
+   const DrainCounts & getLastDrain() const
+   {
+        return m_lastDrain;
+   };
+
+   /// \return sentence counts of all drained polls
+   const DrainCounts & getDrainTotal() const
+   {
+        return m_drainTotal;
+   };
+
    /**
    * Get last polled bearing.
    * \param 
@@ -64,107 +198,133 @@ public:
    std::string getBearing(bool & present)
    {
         present = true;
+        if(!m_formatted)
+        {
+            formatBearing();
+        }
         return m_bearing;
    };
 
+   /**
+   * Get last polled fix, fields are updated in place by every sentence
+   * that carries them.
+   * \return fix record
+   */
+   const CGpsFix & getFix() const
+   {
+        return m_fix;
+   };
+
+   /// Fix members, bits of getWritten()
+   enum Member
+   {
+       MEMBER_POSITION    = 0x0001, ///< latitude, longitude
+       MEMBER_TIME        = 0x0002,
+       MEMBER_DATE        = 0x0004, ///< day, month, year
+       MEMBER_SPEED       = 0x0008,
+       MEMBER_COURSE      = 0x0010,
+       MEMBER_ALTITUDE    = 0x0020,
+       MEMBER_QUALITY     = 0x0040, ///< quality, satellites
+       MEMBER_HDOP        = 0x0080,
+       MEMBER_MODE        = 0x0100,
+       MEMBER_PDOP        = 0x0200,
+       MEMBER_VDOP        = 0x0400,
+       MEMBER_IN_VIEW     = 0x0800, ///< satellitesInView
+       MEMBER_LAT_ERROR   = 0x1000,
+       MEMBER_LON_ERROR   = 0x2000,
+       MEMBER_ALT_ERROR   = 0x4000,
+       MEMBER_VALID       = 0x8000
+   };
+
+   /**
+   * Fix members written by parseSentence() since construction. Unlike the
+   * fix flags, which tell a sentence type was received, a member is only
+   * marked when the sentence had a value for it: an empty HDOP field of a
+   * GGA sets HAS_QUALITY but leaves the previous hdop in place.
+   * \return bits of Member
+   */
+   boost::uint32_t getWritten() const
+   {
+        return m_written;
+   };
+
+   /**
+   * Age of the latest data: time since the newest sentence or frame that
+   * updated the fix was received, not since it was parsed
+   * \return age, very large if nothing was received yet
+   */
+   CByteStream::Clock::duration getFixAge() const
+   {
+        return CByteStream::Clock::now() - m_fix.received;
+   };
+
+   /**
+   * Keep recent fixes, one per receiver epoch, in a time indexed track
+   * \param capacity number of fixes kept, 0 - off
+   */
+   void enableTrack(size_t capacity)
+   {
+        m_track.reserve(capacity);
+        m_trackTime = NO_TIME;
+   };
+
+   /**
+   * Get recent fixes, see enableTrack()
+   * \return track
+   */
+   const CGpsTrack & getTrack() const
+   {
+        return m_track;
+   };
+
   /**
-    * Polls bearing.
+    * Parse NMEA sentence, update bearing.
     * \return true if OK, otherwise false
     */
-    bool parseSentence(std::string & resp_str)
+    bool parseSentence(const std::string & resp_str)
     {
-      size_t tpos;
-      std::vector< std::string > split_vector;
-      std::string sentnc_str;
-      bool ret = false;
-      
-      if( (tpos = resp_str.find("$GPRMC")) != std::string::npos)
-      {
-          /*
-                  GPRMC data
-                  1    = UTC of position fix
-                  2    = Data status (V=navigation receiver warning)
-                  3    = Latitude of fix
-                  4    = N or S
-                  5    = Longitude of fix
-                  6    = E or W
-                  7    = Speed over ground in knots
-                  8    = Track made good in degrees True
-                  9    = UT date
-                  10   = Magnetic variation degrees (Easterly var. subtracts from true course)
-                  11   = E or W
-                  12   = Checksum
-                  */
+      return parseSentence(resp_str.data(), resp_str.size());
+    }
 
-          sentnc_str = resp_str.substr(tpos);
-          if(checksumOK(sentnc_str))
-          {
-              boost::split( split_vector, sentnc_str, is_any_of(","), token_compress_off );
-              if(split_vector.size() >= 11)
-              {
-                  // concatenate words together
-                  m_bearing = convertMMSS(split_vector[3]) + " " + split_vector[4] + ", "; 
-                  m_bearing += convertMMSS(split_vector[5]) + " " + split_vector[6]; 
-		  
-		  m_reads = 0;
-                  ret = true;
-              }
-          }
+  /**
+    * Parse NMEA sentence in place, fields are not copied.
+    * Sentences of any talker (GP, GL, GA, GB/BD, GN...) are dispatched by
+    * their 3-letter type. The sentence is taken as received now.
+    * \param data sentence text
+    * \param size text size
+    * \return true if the sentence carried a position, otherwise false
+    */
+    bool parseSentence(const char *data, size_t size)
+    {
+      return parseSentence(data, size, CByteStream::Clock::now());
+    }
+
+  /**
+    * Parse NMEA sentence in place, fields are not copied.
+    * \param data sentence text
+    * \param size text size
+    * \param received arrival time of the sentence, see CByteStream::getReceiveTime()
+    * \return true if the sentence carried a position, otherwise false
+    */
+    bool parseSentence(const char *data, size_t size, CByteStream::Clock::time_point received)
+    {
+      CNmeaSentence sentence;
+
+      if(!sentence.parse(data, size))
+      {
+          return false;
       }
-      else if( (tpos = resp_str.find("$GPGLL")) != std::string::npos)
+      const SentenceHandler *handler = findHandler(sentence.address());
+      if(!handler)
       {
-        /*
-              eg3. $GPGLL,5133.81,N,00042.25,W*75
-                             1    2         3    4              5
-      
-                    1    5133.81   Current latitude
-                    2    N         North/South
-                    3    00042.25  Current longitude
-                    4    W         East/West
-                    5    *75       checksum        
-               */
-
-        sentnc_str = resp_str.substr(tpos);
-        if(checksumOK(sentnc_str))
-        {
-              boost::split( split_vector, sentnc_str, is_any_of(","), token_compress_off );
-              if(split_vector.size() >= 5)
-              {
-                  m_bearing = convertMMSS(split_vector[1]) + " " + split_vector[2] + ", "; 
-                  m_bearing += convertMMSS(split_vector[3]) + " " + split_vector[4]; 
-                  
-		  m_reads = 0;
-		  ret = true;
-              }
-        }
+          return false;
       }
-      else if( (tpos = resp_str.find("$GPGGA")) != std::string::npos)
+      m_fix.received = received;
+      bool ret = (this->*handler->parse)(sentence);
+      if(ret)
       {
-        /*
-              eg. $GPGGA,211733.00,5618.27292,N,04404.72176,E,1,07,1.21,250.1,M,6.2,M,,*69
-                             1           2     3      4     5 6  7   8   9    10 11 12   14 
-      
-		    1    211733.00    UTC of position fix
-                    2    5618.27292   Current latitude
-                    3    N            North/South
-                    4    04404.72176  Current longitude
-                    5    E            East/West
-                    14   *75          checksum        
-               */
-
-        sentnc_str = resp_str.substr(tpos);
-        if(checksumOK(sentnc_str))
-        {
-              boost::split( split_vector, sentnc_str, is_any_of(","), token_compress_off );
-              if(split_vector.size() >= 13)
-              {
-                  m_bearing = convertMMSS(split_vector[2]) + " " + split_vector[3] + ", "; 
-                  m_bearing += convertMMSS(split_vector[4]) + " " + split_vector[5]; 
-                  
-		  m_reads = 0;
-		  ret = true;
-              }
-        }
+          m_reads = 0;
+          recordFix();
       }
       return ret;
     }
@@ -175,11 +335,14 @@ public:
    */
    bool pollBearing()
    {
+        if(m_protocol == PROTOCOL_UBX)
+        {
+            return pollUbx();
+        }
         ReadStatus resp_status;
-        std::string resp_str;
 	
         // Read NMEA sentence from GPS UART
-        resp_status = readSentence(resp_str);
+        resp_status = readSentence(m_line, GPS_REQUEST_TIMEOUT, m_delim);
 	
 	if(resp_status != DATA)
         {
@@ -187,7 +350,7 @@ public:
 	    return false;
         }
         // Parse the sentence
-        if(!parseSentence(resp_str))
+        if(!parseSentence(m_line.data(), m_line.size(), m_port.getReceiveTime()))
 	{
 	    checkIfBearingsExpired();
 	    return false;
@@ -197,6 +360,120 @@ public:
 
 private:
 
+    /**
+    * Read all pending sentences within the drain budget, parse the newest
+    * of each address in arrival order.
+    * \return true if a parsed sentence carried a position
+    */
+    bool drainSentences()
+    {
+        typedef boost::chrono::steady_clock Clock;
+        Clock::time_point deadline = Clock::now() + boost::chrono::milliseconds(m_drainBudget);
+        size_t used = 0, seq = 0;
+        m_lastDrain.processed = m_lastDrain.dropped = 0;
+
+        // the first sentence may be waited for within the budget, the rest must be received already
+        int timeout = std::min<int>(m_drainBudget, GPS_REQUEST_TIMEOUT);
+        for(;;)
+        {
+            ReadStatus status = readSentence(m_line, timeout, m_delim);
+            if(status != DATA && status != EMPTY)
+            {
+                break;
+            }
+            timeout = GPS_DRAIN_TIMEOUT;
+            if(status == DATA)
+            {
+                boost::uint64_t address = addressKey(m_line);
+                size_t i = 0;
+                while(i < used && m_pending[i].address != address)
+                {
+                    i++;
+                }
+                if(i < used)
+                {
+                    m_lastDrain.dropped++;
+                }
+                else if(used++ == m_pending.size())
+                {
+                    m_pending.push_back(PendingSentence());
+                }
+                // line storage is swapped, not copied
+                m_pending[i].address = address;
+                m_pending[i].seq = seq++;
+                m_pending[i].received = m_port.getReceiveTime();
+                m_pending[i].line.swap(m_line);
+            }
+            if(Clock::now() >= deadline)
+            {
+                break;
+            }
+        }
+
+        bool ret = false;
+        for(size_t n = 0; n < used; n++)
+        {
+            size_t next = n;
+            for(size_t i = n + 1; i < used; i++)
+            {
+                if(m_pending[i].seq < m_pending[next].seq)
+                {
+                    next = i;
+                }
+            }
+            if(next != n)
+            {
+                m_pending[n].swap(m_pending[next]);
+            }
+            const PendingSentence & pending = m_pending[n];
+            if(parseSentence(pending.line.data(), pending.line.size(), pending.received))
+            {
+                ret = true;
+            }
+            m_lastDrain.processed++;
+        }
+        m_drainTotal.processed += m_lastDrain.processed;
+        m_drainTotal.dropped += m_lastDrain.dropped;
+        if(!ret)
+        {
+            checkIfBearingsExpired();
+        }
+        return ret;
+    };
+
+    /// Newest sentence of an address read by drainSentences()
+    struct PendingSentence
+    {
+        boost::uint64_t address; ///< see addressKey()
+        size_t seq;              ///< arrival order
+        CByteStream::Clock::time_point received;
+        std::string line;
+
+        void swap(PendingSentence & other)
+        {
+            std::swap(address, other.address);
+            std::swap(seq, other.seq);
+            std::swap(received, other.received);
+            line.swap(other.line);
+        };
+    };
+
+    /// Pack up to 8 characters of the address "ttsss" of a sentence to a key
+    static boost::uint64_t addressKey(const std::string & line)
+    {
+        boost::uint64_t key = 0;
+        size_t pos = line.find('$');
+        if(pos == std::string::npos)
+        {
+            return 0;
+        }
+        for(size_t i = pos + 1; i < line.size() && i <= pos + 8 && line[i] != ','; i++)
+        {
+            key = (key << 8) | static_cast<unsigned char>(line[i]);
+        }
+        return key;
+    };
+
     enum ReadStatus
     {
         DATA, // ok, some data 
@@ -215,16 +492,23 @@ private:
     
        m_port.setTimeout(boost::posix_time::milliseconds(timeout));
     
-       rc = m_port.readStringUntil(resp_recv, delim);
+       if(m_filter.empty())
+       {
+           rc = m_port.readStringUntil(resp_recv, delim);
+       }
+       else
+       {
+           rc = m_port.readFilteredLine(resp_recv, delim, m_filter, m_skipped);
+       }
     
-       if(rc == CUart::resultTimeoutExpired)
+       if(rc == CByteStream::resultTimeoutExpired)
        {
 #if DEBUG
           printf("%s -- timeout\n", __FUNCTION__);
 #endif
           res = TIMEOUT; // timeout expired
        }
-       else if(rc == CUart::resultError)
+       else if(rc == CByteStream::resultError)
        {
 #if DEBUG
           printf("%s -- read error\n", __FUNCTION__);
@@ -248,72 +532,570 @@ private:
        return res;
     }
 
-    // parse "[m]mmss.xxxx" to "mm ss xx"
-    std::string convertMMSS(const std::string & inp)
+    /**
+    * Read UBX frames up to the next NAV-PVT and decode it. Bad frames are
+    * skipped, the poll ends on a timeout or a read error.
+    * \return true if it carried a position
+    */
+    bool pollUbx()
     {
-        std::string mm, ss;
-        char xxbuf[32];
-        size_t ppos = inp.find(".");
-        if(ppos != std::string::npos)
+        for(int i = 0; i < MAX_UBX_FRAMES_PER_POLL; i++)
         {
-            if(ppos <= 4)
+            ReadStatus status = readFrame(GPS_REQUEST_TIMEOUT);
+            if(status == TIMEOUT || status == READ_ERROR)
             {
-              mm = inp.substr(0, 2);
-              ss = inp.substr(2, 2);
+                break;
             }
-            else
+            if(status != DATA)
             {
-              mm = inp.substr(0, 3);
-              ss = inp.substr(3, 2);
+                continue;
+            }
+            if(ubxClass() == CUbx::CLASS_NAV && ubxId() == CUbx::NAV_PVT)
+            {
+                m_fix.received = m_port.getReceiveTime();
+                if(CUbx::decodeNavPvt(ubxPayload(), ubxPayloadSize(), m_fix))
+                {
+                    m_formatted = false;
+                    m_reads = 0;
+                    recordFix();
+                    return true;
+                }
+                break;
             }
-            int xxv = 60*atof(inp.substr(ppos).c_str());
-            snprintf(xxbuf, sizeof(xxbuf), "%02d", xxv);
-            
         }
-        return mm + " " + ss + " " + xxbuf;
+        checkIfBearingsExpired();
+        return false;
     };
 
-    bool checksumOK(const std::string & str)
+    /**
+    * Wait for the acknowledge of a UBX command
+    * \return 0 - ACK, 1 - timeout, 2 - NAK
+    */
+    int waitAck(unsigned char cls, unsigned char id)
     {
-        bool ret = false;
-        size_t ppos = str.find("$");
-        size_t cpos = str.find("*");
-        uint16_t crc = 0;
-        if(ppos != std::string::npos &&
-           cpos != std::string::npos )
+        for(int i = 0; i < MAX_UBX_FRAMES_PER_POLL; i++)
         {
-            for(size_t pos = ppos+1; pos < cpos; pos++)
+            ReadStatus status = readFrame(GPS_REQUEST_TIMEOUT);
+            if(status == TIMEOUT || status == READ_ERROR)
             {
-                crc ^= static_cast<uint16_t>(str[pos]);
+                break;
             }
-            char* ptr_dummy;
-            uint16_t crc_expected = strtoul(str.substr(cpos + 1).c_str(), &ptr_dummy, 16);
-            if(crc == crc_expected)
+            if(status == DATA && ubxClass() == CUbx::CLASS_ACK && ubxPayloadSize() >= 2 &&
+               ubxPayload()[0] == cls && ubxPayload()[1] == id)
             {
-                //printf("CRC ok. Expect=%u calc=%u\n", crc_expected, crc);
-                ret = true;
+                return ubxId() == CUbx::ACK_ACK ? 0 : 2;
             }
-            else
+        }
+        return 1;
+    };
+
+    /**
+    * Read a UBX frame to m_ubx: class, id, length, payload, checksum.
+    * Bytes before the sync, e.g. NMEA output, are skipped.
+    * \return DATA, EMPTY for a bad frame, TIMEOUT or READ_ERROR
+    */
+    ReadStatus readFrame(int timeout)
+    {
+        m_port.setTimeout(boost::posix_time::milliseconds(timeout));
+        unsigned char sync[2];
+        int rc = m_port.read(reinterpret_cast<char *>(sync), sizeof(sync));
+        for(size_t skipped = 0; rc == CByteStream::resultSuccess; skipped++)
+        {
+            if(sync[0] == CUbx::SYNC_1 && sync[1] == CUbx::SYNC_2)
             {
-#if DEBUG
-                printf("CRC error. Expect=%u calc=%u\n", crc_expected, crc);
-#endif
+                break;
+            }
+            if(skipped > CUbx::MAX_PAYLOAD)
+            {
+                return EMPTY;
+            }
+            sync[0] = sync[1];
+            rc = m_port.read(reinterpret_cast<char *>(sync + 1), 1);
+        }
+        // class, id, length
+        const size_t HEAD = CUbx::HEADER_SIZE - 2;
+        m_ubx.resize(HEAD);
+        if(rc == CByteStream::resultSuccess)
+        {
+            rc = m_port.read(&m_ubx[0], HEAD);
+        }
+        if(rc != CByteStream::resultSuccess)
+        {
+            return rc == CByteStream::resultTimeoutExpired ? TIMEOUT : READ_ERROR;
+        }
+        size_t size = CUbx::get16(reinterpret_cast<const unsigned char *>(m_ubx.data()) + 2);
+        if(size > CUbx::MAX_PAYLOAD)
+        {
+            return EMPTY;
+        }
+        m_ubx.resize(HEAD + size + CUbx::CHECKSUM_SIZE);
+        rc = m_port.read(&m_ubx[HEAD], size + CUbx::CHECKSUM_SIZE);
+        if(rc != CByteStream::resultSuccess)
+        {
+            return rc == CByteStream::resultTimeoutExpired ? TIMEOUT : READ_ERROR;
+        }
+        const unsigned char *frame = reinterpret_cast<const unsigned char *>(m_ubx.data());
+        if(CUbx::checksum(frame, HEAD + size) != CUbx::get16(frame + HEAD + size))
+        {
+            return EMPTY;
+        }
+        return DATA;
+    };
+
+    /// Fields of the frame in m_ubx
+    unsigned char ubxClass() const { return static_cast<unsigned char>(m_ubx[0]); };
+    unsigned char ubxId() const { return static_cast<unsigned char>(m_ubx[1]); };
+    const unsigned char * ubxPayload() const { return reinterpret_cast<const unsigned char *>(m_ubx.data()) + 4; };
+    size_t ubxPayloadSize() const { return m_ubx.size() - 4 - CUbx::CHECKSUM_SIZE; };
+
+    /**
+    * Add the fix to the track, stamped with its arrival time. Sentences of
+    * the epoch of the newest fix, by UTC time, update it instead.
+    */
+    void recordFix()
+    {
+        if(!m_track.capacity())
+        {
+            return;
+        }
+        boost::uint32_t time = NO_TIME;
+        if(m_fix.has(CGpsFix::HAS_TIME))
+        {
+            time = m_fix.time;
+        }
+        if(time == NO_TIME || time != m_trackTime || m_track.empty())
+        {
+            m_track.push(m_fix.received, m_fix);
+            m_trackTime = time;
+        }
+        else
+        {
+            m_track.updateLast(m_fix);
+        }
+    };
+
+    /// Sentence handler, returns true if the sentence carried a position
+    typedef bool (CGps::*SentenceParser)(const CNmeaSentence & sentence);
+
+    /// Dispatch table entry
+    struct SentenceHandler
+    {
+        boost::uint32_t type; ///< 3-letter sentence type, see sentenceType()
+        SentenceParser parse;
+    };
+
+    /// Sentence filter by type, see setSentenceFilter()
+    class TypeFilter : public CByteStream::LineFilter
+    {
+    public:
+        void clear() { m_types.clear(); };
+
+        void add(boost::uint32_t type) { m_types.push_back(type); };
+
+        bool empty() const { return m_types.empty(); };
+
+        /// Accept "$ttsss," with a wanted type, looks at the header only
+        virtual bool accept(const char *data, size_t size) const
+        {
+            const char *p = static_cast<const char *>(memchr(data, '$', size));
+            if(!p || data + size - p < 7 || (p[6] != ',' && p[6] != '*'))
+            {
+                return false;
+            }
+            boost::uint32_t type = sentenceType(p[3], p[4], p[5]);
+            for(size_t i = 0; i < m_types.size(); i++)
+            {
+                if(m_types[i] == type)
+                {
+                    return true;
+                }
             }
+            return false;
+        };
+
+    private:
+        std::vector<boost::uint32_t> m_types;
+    };
+
+    /// Pack 3-letter sentence type to a key
+    static boost::uint32_t sentenceType(char a, char b, char c)
+    {
+        return (static_cast<boost::uint32_t>(static_cast<unsigned char>(a)) << 16) |
+               (static_cast<boost::uint32_t>(static_cast<unsigned char>(b)) << 8) |
+               static_cast<unsigned char>(c);
+    };
+
+    /**
+    * Find the handler of a sentence by the type in its address "ttsss",
+    * the talker ID is not looked at
+    * \return handler, NULL for unknown and proprietary sentences
+    */
+    static const SentenceHandler * findHandler(const CNmeaField & address)
+    {
+        static const SentenceHandler handlers[] =
+        {
+            { 'R' << 16 | 'M' << 8 | 'C', &CGps::parseRMC },
+            { 'G' << 16 | 'G' << 8 | 'A', &CGps::parseGGA },
+            { 'G' << 16 | 'L' << 8 | 'L', &CGps::parseGLL },
+            { 'V' << 16 | 'T' << 8 | 'G', &CGps::parseVTG },
+            { 'G' << 16 | 'S' << 8 | 'A', &CGps::parseGSA },
+            { 'G' << 16 | 'S' << 8 | 'V', &CGps::parseGSV },
+            { 'Z' << 16 | 'D' << 8 | 'A', &CGps::parseZDA },
+            { 'G' << 16 | 'S' << 8 | 'T', &CGps::parseGST }
+        };
+        const char *a = address.data();
+        if(address.size() != 5 || a[0] == 'P')
+        {
+            return NULL;
+        }
+        boost::uint32_t type = sentenceType(a[2], a[3], a[4]);
+        for(size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++)
+        {
+            if(handlers[i].type == type)
+            {
+                return &handlers[i];
+            }
+        }
+        return NULL;
+    };
+
+    /// RMC - recommended minimum data
+    bool parseRMC(const CNmeaSentence & sentence)
+    {
+        /*
+                  RMC data
+                  1    = UTC of position fix
+                  2    = Data status (V=navigation receiver warning)
+                  3    = Latitude of fix
+                  4    = N or S
+                  5    = Longitude of fix
+                  6    = E or W
+                  7    = Speed over ground in knots
+                  8    = Track made good in degrees True
+                  9    = UT date
+                  10   = Magnetic variation degrees (Easterly var. subtracts from true course)
+                  11   = E or W
+                  12   = Checksum
+                  */
+
+        if(sentence.count() < 11)
+        {
+            return false;
+        }
+        bool ret = setPosition(sentence[3], sentence[4], sentence[5], sentence[6]);
+        setValid(sentence[2].toChar() == 'A');
+        setTime(sentence[1]);
+        setNumber(sentence[7], m_fix.speed, CGpsFix::HAS_SPEED, MEMBER_SPEED);
+        setNumber(sentence[8], m_fix.course, CGpsFix::HAS_COURSE, MEMBER_COURSE);
+        if(sentence[9].toDate(m_fix.day, m_fix.month, m_fix.year))
+        {
+            m_fix.flags |= CGpsFix::HAS_DATE;
+            m_written |= MEMBER_DATE;
         }
         return ret;
     };
 
+    /// GLL - geographic position
+    bool parseGLL(const CNmeaSentence & sentence)
+    {
+        /*
+              eg3. $GPGLL,5133.81,N,00042.25,W*75
+                             1    2         3    4              5
+      
+                    1    5133.81   Current latitude
+                    2    N         North/South
+                    3    00042.25  Current longitude
+                    4    W         East/West
+                    5    *75       checksum        
+               */
+
+        if(sentence.count() < 5)
+        {
+            return false;
+        }
+        bool ret = setPosition(sentence[1], sentence[2], sentence[3], sentence[4]);
+        setTime(sentence[5]);
+        if(!sentence[6].empty())
+        {
+            setValid(sentence[6].toChar() == 'A');
+        }
+        return ret;
+    };
+
+    /// GGA - fix data
+    bool parseGGA(const CNmeaSentence & sentence)
+    {
+        /*
+              eg. $GPGGA,211733.00,5618.27292,N,04404.72176,E,1,07,1.21,250.1,M,6.2,M,,*69
+                             1           2     3      4     5 6  7   8   9    10 11 12   14 
+      
+		    1    211733.00    UTC of position fix
+                    2    5618.27292   Current latitude
+                    3    N            North/South
+                    4    04404.72176  Current longitude
+                    5    E            East/West
+                    14   *75          checksum        
+               */
+
+        if(sentence.count() < 13)
+        {
+            return false;
+        }
+        bool ret = setPosition(sentence[2], sentence[3], sentence[4], sentence[5]);
+        setTime(sentence[1]);
+        int quality, satellites;
+        if(sentence[6].toInt(quality) && sentence[7].toInt(satellites))
+        {
+            m_fix.quality = quality;
+            m_fix.satellites = satellites;
+            setNumber(sentence[8], m_fix.hdop, CGpsFix::HAS_QUALITY, MEMBER_HDOP);
+            m_fix.flags |= CGpsFix::HAS_QUALITY;
+            m_written |= MEMBER_QUALITY;
+            setValid(quality > 0);
+        }
+        setNumber(sentence[9], m_fix.altitude, CGpsFix::HAS_ALTITUDE, MEMBER_ALTITUDE);
+        return ret;
+    };
+
+    /**
+    * VTG - course and speed over ground
+    *  1 = Course, degrees true, 2 = T, 3 = Course, degrees magnetic, 4 = M,
+    *  5 = Speed, knots, 6 = N, 7 = Speed, km/h, 8 = K
+    */
+    bool parseVTG(const CNmeaSentence & sentence)
+    {
+        setNumber(sentence[1], m_fix.course, CGpsFix::HAS_COURSE, MEMBER_COURSE);
+        setNumber(sentence[5], m_fix.speed, CGpsFix::HAS_SPEED, MEMBER_SPEED);
+        return false;
+    };
+
+    /**
+    * GSA - DOP and active satellites
+    *  1 = Mode M/A, 2 = Fix type 1 - none, 2 - 2D, 3 - 3D,
+    *  3..14 = PRNs of satellites used, 15 = PDOP, 16 = HDOP, 17 = VDOP
+    */
+    bool parseGSA(const CNmeaSentence & sentence)
+    {
+        int mode;
+        if(sentence.count() < 18 || !sentence[2].toInt(mode))
+        {
+            return false;
+        }
+        m_fix.mode = mode;
+        m_fix.flags |= CGpsFix::HAS_DOP;
+        m_written |= MEMBER_MODE;
+        setNumber(sentence[15], m_fix.pdop, CGpsFix::HAS_DOP, MEMBER_PDOP);
+        setNumber(sentence[16], m_fix.hdop, CGpsFix::HAS_DOP, MEMBER_HDOP);
+        setNumber(sentence[17], m_fix.vdop, CGpsFix::HAS_DOP, MEMBER_VDOP);
+        return false;
+    };
+
+    /**
+    * GSV - satellites in view, one sentence per constellation group of 4
+    *  1 = Number of sentences, 2 = Sentence number, 3 = Satellites in view,
+    *  4..7 = PRN, elevation, azimuth, SNR of a satellite, repeated
+    */
+    bool parseGSV(const CNmeaSentence & sentence)
+    {
+        int in_view;
+        if(!sentence[3].toInt(in_view))
+        {
+            return false;
+        }
+        // talkers count their own satellites, total them
+        const char *talker = sentence.address().data();
+        size_t i = talkerIndex(talker[0], talker[1]);
+        m_inView[i] = in_view;
+        m_inViewEpoch[i] = m_epoch;
+        totalInView();
+        return false;
+    };
+
+    /// Sum the satellites in view of all talkers to the fix
+    void totalInView()
+    {
+        int total = 0;
+        for(size_t i = 0; i < TALKER_COUNT; i++)
+        {
+            total += m_inView[i];
+        }
+        m_fix.satellitesInView = total;
+        m_fix.flags |= CGpsFix::HAS_IN_VIEW;
+        m_written |= MEMBER_IN_VIEW;
+    };
+
+    /**
+    * Start an epoch. A talker that sent no GSV during the whole epoch
+    * before drops out of the satellites in view. One epoch of grace
+    * covers receivers sending GSV ahead of the time of its epoch.
+    */
+    void newEpoch()
+    {
+        m_epoch++;
+        bool aged = false;
+        for(size_t i = 0; i < TALKER_COUNT; i++)
+        {
+            if(m_inView[i] && m_inViewEpoch[i] + 1 < m_epoch)
+            {
+                m_inView[i] = 0;
+                aged = true;
+            }
+        }
+        if(aged)
+        {
+            totalInView();
+        }
+    };
+
+    /**
+    * ZDA - time and date
+    *  1 = UTC time, 2 = Day, 3 = Month, 4 = Year, 5,6 = Local zone hours, minutes
+    */
+    bool parseZDA(const CNmeaSentence & sentence)
+    {
+        int day, month, year;
+        setTime(sentence[1]);
+        if(sentence[2].toInt(day) && sentence[3].toInt(month) && sentence[4].toInt(year))
+        {
+            m_fix.day = day;
+            m_fix.month = month;
+            m_fix.year = year;
+            m_fix.flags |= CGpsFix::HAS_DATE;
+            m_written |= MEMBER_DATE;
+        }
+        return false;
+    };
+
+    /**
+    * GST - position error statistics
+    *  1 = UTC time, 2 = RMS of pseudorange residuals, 3,4,5 = Error ellipse,
+    *  6 = Latitude error, m, 7 = Longitude error, m, 8 = Altitude error, m
+    */
+    bool parseGST(const CNmeaSentence & sentence)
+    {
+        setNumber(sentence[6], m_fix.latError, CGpsFix::HAS_ERROR, MEMBER_LAT_ERROR);
+        setNumber(sentence[7], m_fix.lonError, CGpsFix::HAS_ERROR, MEMBER_LON_ERROR);
+        setNumber(sentence[8], m_fix.altError, CGpsFix::HAS_ERROR, MEMBER_ALT_ERROR);
+        return false;
+    };
+
+    /// Talkers counted separately in GSV
+    enum { TALKER_GPS, TALKER_GLONASS, TALKER_GALILEO, TALKER_BEIDOU, TALKER_QZSS, TALKER_OTHER, TALKER_COUNT };
+
+    /// \return talker slot of a talker ID
+    static size_t talkerIndex(char a, char b)
+    {
+        if(a == 'G' && b == 'P') return TALKER_GPS;
+        if(a == 'G' && b == 'L') return TALKER_GLONASS;
+        if(a == 'G' && b == 'A') return TALKER_GALILEO;
+        if((a == 'G' && b == 'B') || (a == 'B' && b == 'D')) return TALKER_BEIDOU;
+        if(a == 'G' && b == 'Q') return TALKER_QZSS;
+        return TALKER_OTHER;
+    };
+
+    /**
+    * Decode "[d]ddmm.mmmm" latitude and longitude with hemispheres to the fix
+    * \return true if both coordinates are valid
+    */
+    bool setPosition(const CNmeaField & lat, const CNmeaField & lat_hemi,
+                     const CNmeaField & lon, const CNmeaField & lon_hemi)
+    {
+        double lat_deg, lon_deg;
+        char ns = lat_hemi.toChar(), ew = lon_hemi.toChar();
+        if(!lat.toCoordinate(lat_deg) || !lon.toCoordinate(lon_deg) ||
+           (ns != 'N' && ns != 'S') || (ew != 'E' && ew != 'W'))
+        {
+            return false;
+        }
+        m_fix.latitude = (ns == 'S') ? -lat_deg : lat_deg;
+        m_fix.longitude = (ew == 'W') ? -lon_deg : lon_deg;
+        m_fix.flags |= CGpsFix::HAS_POSITION;
+        m_written |= MEMBER_POSITION;
+        // bearing string is formatted when asked for
+        m_formatted = false;
+        return true;
+    };
+
+    /// Decode UTC time to the fix
+    void setTime(const CNmeaField & field)
+    {
+        boost::uint32_t time;
+        if(field.toTime(time))
+        {
+            if(!(m_fix.flags & CGpsFix::HAS_TIME) || time != m_fix.time)
+            {
+                newEpoch();
+            }
+            m_fix.time = time;
+            m_fix.flags |= CGpsFix::HAS_TIME;
+            m_written |= MEMBER_TIME;
+        }
+    };
+
+    /// Decode a number to a fix field, an empty field keeps the value
+    template <class T>
+    void setNumber(const CNmeaField & field, T & value, CGpsFix::Field flag, Member member)
+    {
+        double v;
+        if(field.toDouble(v))
+        {
+            value = static_cast<T>(v);
+            m_fix.flags |= flag;
+            m_written |= member;
+        }
+    };
+
+    void setValid(bool valid)
+    {
+        m_fix.valid = valid;
+        m_fix.flags |= CGpsFix::HAS_STATUS;
+        m_written |= MEMBER_VALID;
+    };
+
+    /**
+    * Format the fix position as "mm ss xx H, mmm ss xx H" to m_bearing
+    */
+    void formatBearing()
+    {
+        char buf[64];
+        int n = formatCoordinate(buf, sizeof(buf), m_fix.latitude, 2, 'N', 'S');
+        n += snprintf(buf + n, sizeof(buf) - n, ", ");
+        n += formatCoordinate(buf + n, sizeof(buf) - n, m_fix.longitude, 3, 'E', 'W');
+        // reuses the string storage
+        m_bearing.assign(buf, n);
+        m_formatted = true;
+    };
+
+    /**
+    * Format degrees as "dd mm ss H", seconds truncated
+    * \param width number of degree digits
+    * \return number of characters written
+    */
+    static int formatCoordinate(char *buf, size_t size, double value, int width, char pos, char neg)
+    {
+        // whole 1e-5 minutes, the resolution of NMEA coordinates
+        boost::int64_t m = static_cast<boost::int64_t>(fabs(value) * 6000000.0 + 0.5);
+        return snprintf(buf, size, "%0*d %02d %02d %c", width,
+                        static_cast<int>(m / 6000000), static_cast<int>(m / 100000 % 60),
+                        static_cast<int>(m % 100000 * 60 / 100000), value < 0 ? neg : pos);
+    };
+
     /// see comments for MAX_MSGS_WIHTOUT_BEARINGS for explanation
     void checkIfBearingsExpired()
     {
 	if(++m_reads > MAX_MSGS_WIHTOUT_BEARINGS)
+	{
 	    m_bearing = "NO_BEARINGS";
+	    m_formatted = true;
+	    m_fix.valid = false;
+	}
     }
     
     /// GPS timeouts
     enum GPS_Timeout
     {
-        GPS_REQUEST_TIMEOUT  = 1000 // msec
+        GPS_REQUEST_TIMEOUT  = 1000, // msec
+        GPS_DRAIN_TIMEOUT    = 1     // msec, sentences after the first one in drain mode
     };
 
     /* Not every GPS message contains bearings. We extract them when they are present and skip messages
@@ -322,15 +1104,73 @@ private:
      * we know that something went wrong with GPS unit.
      */
     static const int MAX_MSGS_WIHTOUT_BEARINGS = 10;
+
+    /// UBX frames read at most by one poll or acknowledge wait
+    static const int MAX_UBX_FRAMES_PER_POLL = 32;
     
     /// See comment for MAX_MSGS_WIHTOUT_BEARINGS
     int m_reads;
     
-   /// Position string
+   /// Position string, formatted from m_fix when asked for
    std::string m_bearing;
 
+   /// m_bearing is up to date
+   bool m_formatted;
+
+   /// Last fix
+   CGpsFix m_fix;
+
+   /// Members of m_fix written by sentences, see getWritten()
+   boost::uint32_t m_written;
+
+   /// Recent fixes
+   CGpsTrack m_track;
+
+   /// UTC time of the newest fix in m_track
+   boost::uint32_t m_trackTime;
+
+   /// m_trackTime when unknown
+   static const boost::uint32_t NO_TIME = 0xFFFFFFFF;
+
+   /// Satellites in view by talker, see talkerIndex()
+   int m_inView[TALKER_COUNT];
+
+   /// Epoch count, advanced by each new fix time
+   unsigned m_epoch;
+
+   /// m_epoch of the last GSV of each talker
+   unsigned m_inViewEpoch[TALKER_COUNT];
+
+   /// Last sentence read, storage reused between reads
+   std::string m_line;
+
    /// UART port object
-   CUart & m_port;
+   CByteStream & m_port;
+
+   /// NMEA sentence delimiter
+   std::string m_delim;
+
+   /// Wanted sentence types, empty - all
+   TypeFilter m_filter;
+
+   /// Lines discarded by m_filter
+   size_t m_skipped;
+
+   /// Protocol read by pollBearing()
+   Protocol m_protocol;
+
+   /// Last UBX frame without sync: class, id, length, payload, checksum
+   std::string m_ubx;
+
+   /// Drain mode time budget of Poll(), msec, 0 - off
+   int m_drainBudget;
+
+   /// Newest sentences by address, storage reused between polls
+   std::vector<PendingSentence> m_pending;
+
+   /// Sentence counts of drained polls
+   DrainCounts m_lastDrain;
+   DrainCounts m_drainTotal;
 
    /// Init flag
    bool m_initialized;
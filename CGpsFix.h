@@ -0,0 +1,70 @@
+#ifndef __CGPSFIX_H__
+#define __CGPSFIX_H__
+
+#include <boost/cstdint.hpp>
+#include <boost/chrono.hpp>
+
+// --------------------------------------------
+/// Position fix decoded from NMEA sentences.
+/// Kept by CGps and updated in place by every sentence that carries any of
+/// the fields, flags tell which fields were received so far.
+struct CGpsFix
+{
+    /// Received fields, bits of flags
+    enum Field
+    {
+        HAS_POSITION   = 0x01, ///< latitude, longitude
+        HAS_TIME       = 0x02, ///< time
+        HAS_DATE       = 0x04, ///< day, month, year
+        HAS_SPEED      = 0x08, ///< speed
+        HAS_COURSE     = 0x10, ///< course
+        HAS_ALTITUDE   = 0x20, ///< altitude
+        HAS_QUALITY    = 0x40, ///< quality, satellites, hdop
+        HAS_DOP        = 0x80, ///< mode, pdop, hdop, vdop
+        HAS_IN_VIEW    = 0x100,///< satellitesInView
+        HAS_ERROR      = 0x200,///< latError, lonError, altError
+        HAS_STATUS     = 0x400 ///< valid
+    };
+
+    CGpsFix() { clear(); };
+
+    void clear()
+    {
+        latitude = longitude = altitude = 0;
+        speed = course = hdop = pdop = vdop = 0;
+        latError = lonError = altError = 0;
+        time = 0;
+        year = 0;
+        month = day = quality = satellites = satellitesInView = mode = 0;
+        valid = false;
+        flags = 0;
+        received = boost::chrono::steady_clock::time_point();
+    };
+
+    bool has(Field f) const { return (flags & f) != 0; };
+
+    double latitude;            ///< degrees, north positive
+    double longitude;           ///< degrees, east positive
+    double altitude;            ///< meters above mean sea level
+    float speed;                ///< speed over ground, knots
+    float course;               ///< course over ground, degrees true
+    float hdop;                 ///< horizontal dilution of precision
+    float pdop;                 ///< position dilution of precision
+    float vdop;                 ///< vertical dilution of precision
+    float latError;             ///< latitude error, 1 sigma, meters
+    float lonError;             ///< longitude error, 1 sigma, meters
+    float altError;             ///< altitude error, 1 sigma, meters
+    boost::uint32_t time;       ///< UTC time of fix, msec since midnight
+    boost::uint16_t year;       ///< UTC date
+    boost::uint8_t month;
+    boost::uint8_t day;
+    boost::uint8_t quality;     ///< GGA fix quality, 0 - no fix
+    boost::uint8_t satellites;  ///< satellites in use
+    boost::uint8_t satellitesInView; ///< satellites in view, all constellations
+    boost::uint8_t mode;        ///< GSA fix type: 1 - no fix, 2 - 2D, 3 - 3D
+    bool valid;                 ///< receiver reports the position valid
+    boost::uint16_t flags;      ///< received fields, see Field
+    boost::chrono::steady_clock::time_point received; ///< arrival of the newest data, steady clock
+};
+
+#endif // __CGPSFIX_H__
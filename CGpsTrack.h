@@ -0,0 +1,238 @@
+#ifndef __CGPSTRACK_H__
+#define __CGPSTRACK_H__
+
+#include <cmath>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/chrono.hpp>
+
+#include "CGpsFix.h"
+
+// --------------------------------------------
+/// Recent fixes, time indexed.
+/// Fixed-capacity ring in structure-of-arrays layout: a lookup by time
+/// binary searches the timestamp array only, then reads the few fields it
+/// needs. Timestamps are monotonic (steady clock) and must not decrease,
+/// the oldest fix is overwritten when the ring is full. Nothing is
+/// allocated after construction.
+class CGpsTrack
+{
+public:
+    typedef boost::chrono::steady_clock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /// Fix at a point of time
+    struct Point
+    {
+        TimePoint stamp;
+        double latitude;    ///< degrees, north positive
+        double longitude;   ///< degrees, east positive
+        double altitude;    ///< meters above mean sea level
+        float speed;        ///< knots
+        float course;       ///< degrees true
+    };
+
+    /**
+    * \param capacity number of fixes kept, rounded up to a power of 2;
+    *  0 - track disabled
+    */
+    explicit CGpsTrack(size_t capacity = 0) : m_mask(0), m_head(0), m_size(0)
+    {
+        reserve(capacity);
+    };
+
+    /**
+    * Set the capacity, the track is cleared
+    * \param capacity number of fixes kept, rounded up to a power of 2
+    */
+    void reserve(size_t capacity)
+    {
+        size_t n = 0;
+        if(capacity)
+        {
+            for(n = 1; n < capacity; n <<= 1) {}
+        }
+        m_stamp.assign(n, 0);
+        m_latitude.assign(n, 0);
+        m_longitude.assign(n, 0);
+        m_altitude.assign(n, 0);
+        m_speed.assign(n, 0);
+        m_course.assign(n, 0);
+        m_mask = n ? n - 1 : 0;
+        clear();
+    };
+
+    void clear() { m_head = m_size = 0; };
+
+    size_t capacity() const { return m_stamp.size(); };
+
+    size_t size() const { return m_size; };
+
+    bool empty() const { return m_size == 0; };
+
+    /**
+    * Append a fix
+    * \param stamp time the fix was received
+    * \return false if the track is disabled or stamp is older than the newest fix
+    */
+    bool push(TimePoint stamp, const CGpsFix & fix)
+    {
+        boost::int64_t t = ticks(stamp);
+        if(!capacity() || (m_size && t < m_stamp[slot(m_size - 1)]))
+        {
+            return false;
+        }
+        size_t i = (m_head + m_size) & m_mask;
+        if(m_size == capacity())
+        {
+            m_head = (m_head + 1) & m_mask;
+        }
+        else
+        {
+            m_size++;
+        }
+        m_stamp[i] = t;
+        store(i, fix);
+        return true;
+    };
+
+    /**
+    * Update the newest fix in place, e.g. from another sentence of the same epoch
+    * \return false if the track is empty
+    */
+    bool updateLast(const CGpsFix & fix)
+    {
+        if(!m_size)
+        {
+            return false;
+        }
+        store(slot(m_size - 1), fix);
+        return true;
+    };
+
+    /**
+    * \param i 0 - oldest fix, size() - 1 - newest
+    * \return fix i
+    */
+    Point at(size_t i) const
+    {
+        Point p;
+        size_t k = slot(i);
+        p.stamp = TimePoint(Clock::duration(m_stamp[k]));
+        p.latitude = m_latitude[k];
+        p.longitude = m_longitude[k];
+        p.altitude = m_altitude[k];
+        p.speed = m_speed[k];
+        p.course = m_course[k];
+        return p;
+    };
+
+    /// \return index of the first fix not older than stamp, size() if none
+    size_t lowerBound(TimePoint stamp) const
+    {
+        boost::int64_t t = ticks(stamp);
+        size_t first = 0, count = m_size;
+        while(count > 0)
+        {
+            size_t half = count / 2;
+            if(m_stamp[slot(first + half)] < t)
+            {
+                first += half + 1;
+                count -= half + 1;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+        return first;
+    };
+
+    /**
+    * Fixes received in [from, to)
+    * \param [out] first index of the first fix
+    * \return number of fixes, at indexes first...
+    */
+    size_t range(TimePoint from, TimePoint to, size_t & first) const
+    {
+        first = lowerBound(from);
+        size_t last = lowerBound(to);
+        return last > first ? last - first : 0;
+    };
+
+    /**
+    * Position at a point of time, interpolated linearly between the fixes
+    * around it
+    * \param [out] out position, stamp set to the time asked for
+    * \return false if the time is outside the track
+    */
+    bool interpolate(TimePoint stamp, Point & out) const
+    {
+        size_t i = lowerBound(stamp);
+        if(i == m_size)
+        {
+            return false;
+        }
+        out = at(i);
+        if(out.stamp == stamp)
+        {
+            return true;
+        }
+        if(i == 0)
+        {
+            return false;
+        }
+        Point prev = at(i - 1);
+        double f = static_cast<double>(ticks(stamp) - ticks(prev.stamp)) / (ticks(out.stamp) - ticks(prev.stamp));
+        out.latitude = prev.latitude + (out.latitude - prev.latitude) * f;
+        out.longitude = wrap180(prev.longitude + wrap180(out.longitude - prev.longitude) * f);
+        out.altitude = prev.altitude + (out.altitude - prev.altitude) * f;
+        out.speed = static_cast<float>(prev.speed + (out.speed - prev.speed) * f);
+        out.course = static_cast<float>(fmod(prev.course + wrap180(out.course - prev.course) * f + 360.0, 360.0));
+        out.stamp = stamp;
+        return true;
+    };
+
+    /**
+    * Position some time ago, e.g. ago(boost::chrono::seconds(10), p)
+    * \return false if there are no fixes around that time
+    */
+    bool ago(Clock::duration age, Point & out) const
+    {
+        return interpolate(Clock::now() - age, out);
+    };
+
+private:
+    static boost::int64_t ticks(TimePoint t) { return t.time_since_epoch().count(); };
+
+    /// Angle difference to -180..180
+    static double wrap180(double a)
+    {
+        if(a > 180) return a - 360;
+        if(a < -180) return a + 360;
+        return a;
+    };
+
+    size_t slot(size_t i) const { return (m_head + i) & m_mask; };
+
+    void store(size_t i, const CGpsFix & fix)
+    {
+        m_latitude[i] = fix.latitude;
+        m_longitude[i] = fix.longitude;
+        m_altitude[i] = fix.altitude;
+        m_speed[i] = fix.speed;
+        m_course[i] = fix.course;
+    };
+
+    std::vector<boost::int64_t> m_stamp; ///< steady clock ticks
+    std::vector<double> m_latitude;
+    std::vector<double> m_longitude;
+    std::vector<double> m_altitude;
+    std::vector<float> m_speed;
+    std::vector<float> m_course;
+    size_t m_mask;  ///< capacity - 1
+    size_t m_head;  ///< slot of the oldest fix
+    size_t m_size;
+};
+
+#endif // __CGPSTRACK_H__
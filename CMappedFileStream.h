@@ -0,0 +1,131 @@
+#ifndef __CMAPPEDFILESTREAM_H__
+#define __CMAPPEDFILESTREAM_H__
+
+#include <string>
+#include <boost/utility.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "CByteStream.h"
+
+// --------------------------------------------
+/// Byte stream over a memory-mapped log file.
+/// Replays recorded device output (e.g. NMEA logs) at full disk speed:
+/// lines are found and copied straight from the mapping, with no read
+/// syscalls and no intermediate buffer. Writes are discarded, timeouts
+/// do not apply. At end of file reads return resultError and eof() is true.
+class CMappedFileStream : public CByteStream, private boost::noncopyable
+{
+public:
+    CMappedFileStream() : m_pos(0) {};
+
+    /**
+    * Map a file
+    * \param file_name file to map
+    * \throws std::ios_base::failure if the file cannot be mapped
+    */
+    explicit CMappedFileStream(const std::string & file_name) : m_pos(0) { open(file_name); };
+
+    virtual ~CMappedFileStream() { close(); };
+
+    /**
+    * Map a file, reading starts at its beginning
+    * \param file_name file to map
+    * \throws std::ios_base::failure if the file cannot be mapped
+    */
+    void open(const std::string & file_name)
+    {
+        close();
+        m_file.open(file_name);
+        m_pos = 0;
+    };
+
+    virtual bool isOpen() const { return m_file.is_open(); };
+
+    virtual void close()
+    {
+        if(m_file.is_open())
+        {
+            m_file.close();
+        }
+        m_pos = 0;
+    };
+
+    virtual void setTimeout(const boost::posix_time::time_duration &) {};
+
+    virtual void write(const char *, size_t) {};
+
+    virtual void writeString(const std::string &) {};
+
+    virtual int read(char *data, size_t size)
+    {
+        if(remaining() < size)
+        {
+            m_pos = m_file.size();
+            return resultError;
+        }
+        memcpy(data, m_file.data() + m_pos, size);
+        m_pos += size;
+        return resultSuccess;
+    };
+
+    /**
+    * Read a line from the mapping.
+    * The last line of the file is returned even without delimiter.
+    */
+    virtual int readStringUntil(std::string &out, const std::string& delim="\n")
+    {
+        if(remaining() == 0)
+        {
+            return resultError;
+        }
+        const char *p = m_file.data() + m_pos;
+        const char *pos = findDelim(p, remaining(), delim);
+        size_t len = pos ? pos - p : remaining();
+        appendPrintable(out, p, len);
+        m_pos += pos ? len + delim.size() : len;
+        return resultSuccess;
+    };
+
+    /// Lines are filtered in the mapping, rejected lines are only skipped
+    virtual int readFilteredLine(std::string &out, const std::string& delim,
+            const LineFilter& filter, size_t &skipped)
+    {
+        while(remaining() > 0)
+        {
+            const char *p = m_file.data() + m_pos;
+            const char *pos = findDelim(p, remaining(), delim);
+            size_t len = pos ? pos - p : remaining();
+            m_pos += pos ? len + delim.size() : len;
+            if(filter.accept(p, len))
+            {
+                appendPrintable(out, p, len);
+                return resultSuccess;
+            }
+            skipped++;
+        }
+        return resultError;
+    };
+
+    /// Recorded data has no arrival time, it is taken as arriving when read
+    virtual Clock::time_point getReceiveTime() const { return Clock::now(); };
+
+    /// \return true if all data was read
+    bool eof() const { return remaining() == 0; };
+
+    /// \return file size, bytes
+    size_t size() const { return m_file.is_open() ? m_file.size() : 0; };
+
+    /// \return read position, bytes from the beginning of the file
+    size_t tell() const { return m_pos; };
+
+    /// \return mapped file contents
+    const char * data() const { return m_file.data(); };
+
+private:
+    size_t remaining() const { return m_file.is_open() ? m_file.size() - m_pos : 0; };
+
+    boost::iostreams::mapped_file_source m_file;
+    size_t m_pos;
+};
+
+#endif // __CMAPPEDFILESTREAM_H__
@@ -0,0 +1,199 @@
+#ifndef __CNMEACHECKSUM_H__
+#define __CNMEACHECKSUM_H__
+
+#include <cstring>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NMEA_CHECKSUM_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NMEA_CHECKSUM_NEON
+#endif
+
+#include "CNmeaField.h"
+
+// --------------------------------------------
+/// NMEA 0183 checksum validation.
+/// The payload between '$' and '*' is XORed 16 bytes at a time with SSE2 or
+/// NEON, 8 bytes at a time elsewhere, and the "*hh" pair is decoded in
+/// place. validateBatch() checks every line of a buffer, e.g. a memory
+/// mapped log, without copying.
+class CNmeaChecksum
+{
+public:
+    /**
+    * XOR of all bytes
+    * \param data bytes
+    * \param size number of bytes
+    */
+    static unsigned char xorBytes(const char *data, size_t size)
+    {
+        size_t pos = 0;
+        unsigned char crc = 0;
+#if defined(NMEA_CHECKSUM_SSE2)
+        if(size >= 16)
+        {
+            __m128i acc = _mm_setzero_si128();
+            for(; pos + 16 <= size; pos += 16)
+            {
+                acc = _mm_xor_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos)));
+            }
+            acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+            acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 4));
+            acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 2));
+            acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 1));
+            crc = static_cast<unsigned char>(_mm_cvtsi128_si32(acc));
+        }
+#elif defined(NMEA_CHECKSUM_NEON)
+        if(size >= 16)
+        {
+            uint8x16_t acc = vdupq_n_u8(0);
+            for(; pos + 16 <= size; pos += 16)
+            {
+                acc = veorq_u8(acc, vld1q_u8(reinterpret_cast<const uint8_t *>(data + pos)));
+            }
+            uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+            crc = foldWord(vgetq_lane_u64(acc64, 0) ^ vgetq_lane_u64(acc64, 1));
+        }
+#endif
+        if(size - pos >= 8)
+        {
+            boost::uint64_t acc = 0;
+            for(boost::uint64_t v; pos + sizeof(v) <= size; pos += sizeof(v))
+            {
+                memcpy(&v, data + pos, sizeof(v));
+                acc ^= v;
+            }
+            crc ^= foldWord(acc);
+        }
+        for(; pos < size; pos++)
+        {
+            crc ^= static_cast<unsigned char>(data[pos]);
+        }
+        return crc;
+    };
+
+    /**
+    * Check the checksum of a sentence "$...*hh". Characters before '$' and
+    * after the hex pair are ignored.
+    * \param data sentence text
+    * \param size text size
+    * \param [out] star position of '*', if not NULL
+    * \return true if the checksum is present and valid
+    */
+    static bool validate(const char *data, size_t size, const char **star = NULL)
+    {
+        const char *end = data + size;
+        const char *begin = static_cast<const char *>(memchr(data, '$', size));
+        if(!begin)
+        {
+            return false;
+        }
+        const char *p = static_cast<const char *>(memchr(begin, '*', end - begin));
+        if(star)
+        {
+            *star = p;
+        }
+        return checkSentence(begin, p, end);
+    };
+
+    /**
+    * Validate all sentences of a buffer, one per line.
+    * Empty lines are skipped.
+    * \param data buffer
+    * \param size buffer size
+    * \param [out] invalid number of lines failing validation
+    * \param [out] valid views of valid sentences, from '$' to the hex pair,
+    *  appended if not NULL
+    * \return number of valid sentences
+    */
+    static size_t validateBatch(const char *data, size_t size, size_t & invalid,
+                                std::vector<CNmeaField> *valid = NULL)
+    {
+        size_t count = 0;
+        invalid = 0;
+        const char *end = data + size;
+        for(const char *line = data; line < end; )
+        {
+            const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+            const char *line_end = eol ? eol : end;
+            const char *stop = (line_end > line && line_end[-1] == '\r') ? line_end - 1 : line_end;
+            // usual layout "$...*hh" is checked without searching the line
+            const char *begin = NULL;
+            if(stop > line)
+            {
+                begin = (*line == '$') ? line : static_cast<const char *>(memchr(line, '$', stop - line));
+            }
+            const char *star = NULL;
+            if(begin)
+            {
+                star = (stop - begin >= 4 && stop[-3] == '*') ? stop - 3 :
+                       static_cast<const char *>(memchr(begin, '*', stop - begin));
+            }
+            if(begin && checkSentence(begin, star, stop))
+            {
+                count++;
+                if(valid)
+                {
+                    valid->push_back(CNmeaField(begin, star + 3 - begin));
+                }
+            }
+            else if(!isBlank(line, line_end))
+            {
+                invalid++;
+            }
+            line = line_end + 1;
+        }
+        return count;
+    };
+
+    /// \return value of a hex digit, -1 if not a hex digit
+    static int hexValue(char c)
+    {
+        if(c >= '0' && c <= '9') return c - '0';
+        if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    };
+
+private:
+    /**
+    * Check "$...*hh"
+    * \param begin position of '$'
+    * \param star position of '*', NULL if not found
+    * \param end end of text, after the hex pair or further
+    */
+    static bool checkSentence(const char *begin, const char *star, const char *end)
+    {
+        if(!star || end - star < 3)
+        {
+            return false;
+        }
+        int hi = hexValue(star[1]), lo = hexValue(star[2]);
+        if(hi < 0 || lo < 0)
+        {
+            return false;
+        }
+        return xorBytes(begin + 1, star - begin - 1) == ((hi << 4) | lo);
+    };
+
+    /// XOR of the 8 bytes of a word
+    static unsigned char foldWord(boost::uint64_t v)
+    {
+        v ^= v >> 32;
+        v ^= v >> 16;
+        v ^= v >> 8;
+        return static_cast<unsigned char>(v);
+    };
+
+    /// \return true if the line holds only a line terminator
+    static bool isBlank(const char *begin, const char *end)
+    {
+        return begin == end || (end - begin == 1 && *begin == '\r');
+    };
+};
+
+#endif // __CNMEACHECKSUM_H__
@@ -0,0 +1,163 @@
+#ifndef __CNMEAFIELD_H__
+#define __CNMEAFIELD_H__
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+// --------------------------------------------
+/// View of one field of an NMEA sentence.
+/// Points into the buffer the sentence was parsed from, no copy is made.
+/// Numbers are decoded straight from the characters.
+class CNmeaField
+{
+public:
+    CNmeaField() : m_data(NULL), m_size(0) {};
+    CNmeaField(const char *data, size_t size) : m_data(data), m_size(size) {};
+
+    const char * data() const { return m_data; };
+    size_t size() const { return m_size; };
+    bool empty() const { return m_size == 0; };
+
+    /// \return true if field equals the string
+    bool equals(const char *s) const
+    {
+        return strlen(s) == m_size && memcmp(s, m_data, m_size) == 0;
+    };
+
+    /// \return first character, 0 if the field is empty
+    char toChar() const { return m_size ? m_data[0] : 0; };
+
+    /**
+    * Decode a decimal number "[-]ddd[.ddd]"
+    * \param [out] value decoded number
+    * \return true if the field is a valid number
+    */
+    bool toDouble(double & value) const
+    {
+        size_t pos = 0;
+        bool negative = false;
+        if(pos < m_size && (m_data[pos] == '-' || m_data[pos] == '+'))
+        {
+            negative = m_data[pos++] == '-';
+        }
+        double v = 0;
+        size_t digits = 0;
+        for(; pos < m_size && isDigit(m_data[pos]); pos++, digits++)
+        {
+            v = v * 10 + (m_data[pos] - '0');
+        }
+        if(pos < m_size && m_data[pos] == '.')
+        {
+            double scale = 1;
+            for(pos++; pos < m_size && isDigit(m_data[pos]); pos++, digits++)
+            {
+                v = v * 10 + (m_data[pos] - '0');
+                scale *= 10;
+            }
+            v /= scale;
+        }
+        if(pos != m_size || digits == 0)
+        {
+            return false;
+        }
+        value = negative ? -v : v;
+        return true;
+    };
+
+    /**
+    * Decode an integer, fraction if any is ignored
+    * \param [out] value decoded number
+    * \return true if the field is a valid number
+    */
+    bool toInt(int & value) const
+    {
+        double v;
+        if(!toDouble(v))
+        {
+            return false;
+        }
+        value = static_cast<int>(v);
+        return true;
+    };
+
+    /**
+    * Decode a coordinate "[d]ddmm.mmmm" to degrees
+    * \param [out] degrees decoded coordinate, not negative
+    * \return true if the field is a valid coordinate
+    */
+    bool toCoordinate(double & degrees) const
+    {
+        const char *dot = static_cast<const char *>(memchr(m_data, '.', m_size));
+        size_t int_len = dot ? dot - m_data : m_size;
+        double minutes;
+        if(int_len < 3 || !isDigit(m_data[int_len - 2]) ||
+           !CNmeaField(m_data + int_len - 2, m_size - int_len + 2).toDouble(minutes))
+        {
+            return false;
+        }
+        int deg = 0;
+        for(size_t pos = 0; pos < int_len - 2; pos++)
+        {
+            if(!isDigit(m_data[pos]))
+            {
+                return false;
+            }
+            deg = deg * 10 + (m_data[pos] - '0');
+        }
+        degrees = deg + minutes / 60;
+        return true;
+    };
+
+    /**
+    * Decode UTC time "hhmmss[.sss]"
+    * \param [out] msec milliseconds since midnight
+    * \return true if the field is a valid time
+    */
+    bool toTime(boost::uint32_t & msec) const
+    {
+        double sec;
+        if(m_size < 6 || !isDigit(m_data[0]) || !isDigit(m_data[1]) || !isDigit(m_data[2]) ||
+           !isDigit(m_data[3]) || !isDigit(m_data[4]) || !CNmeaField(m_data + 4, m_size - 4).toDouble(sec))
+        {
+            return false;
+        }
+        int hh = (m_data[0] - '0') * 10 + (m_data[1] - '0');
+        int mm = (m_data[2] - '0') * 10 + (m_data[3] - '0');
+        msec = (hh * 3600 + mm * 60) * 1000 + static_cast<boost::uint32_t>(sec * 1000 + 0.5);
+        return true;
+    };
+
+    /**
+    * Decode date "ddmmyy"
+    * \param [out] year four digit year
+    * \return true if the field is a valid date
+    */
+    bool toDate(boost::uint8_t & day, boost::uint8_t & month, boost::uint16_t & year) const
+    {
+        if(m_size != 6)
+        {
+            return false;
+        }
+        for(size_t pos = 0; pos < m_size; pos++)
+        {
+            if(!isDigit(m_data[pos]))
+            {
+                return false;
+            }
+        }
+        day = (m_data[0] - '0') * 10 + (m_data[1] - '0');
+        month = (m_data[2] - '0') * 10 + (m_data[3] - '0');
+        int yy = (m_data[4] - '0') * 10 + (m_data[5] - '0');
+        // two digit year, NMEA 0183 came out in the 80s
+        year = (yy < 80) ? 2000 + yy : 1900 + yy;
+        return true;
+    };
+
+private:
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; };
+
+    const char *m_data;
+    size_t m_size;
+};
+
+#endif // __CNMEAFIELD_H__
@@ -0,0 +1,254 @@
+#ifndef __CNMEAIMPORTER_H__
+#define __CNMEAIMPORTER_H__
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "CGps.h"
+#include "CGpsFix.h"
+
+// --------------------------------------------
+/// Bulk importer of recorded NMEA logs.
+/// The log is memory mapped and split into chunks at line boundaries. The
+/// chunks are parsed in parallel by CGps instances on a pool of threads,
+/// each sentence that carries a position yields a fix. The fixes are then
+/// merged in file order: each chunk starts with an empty fix, so the members
+/// its sentences did not write yet, see CGps::getWritten(), are carried over
+/// from the state at the end of the previous chunks. The result equals a
+/// sequential parse, except for satellitesInView, which only totals the
+/// talkers seen since the start of the chunk until their next GSV.
+class CNmeaImporter : private boost::noncopyable
+{
+public:
+    /// Import statistics
+    struct Stats
+    {
+        size_t bytes;       ///< log size
+        size_t sentences;   ///< non-empty lines
+        size_t fixes;       ///< fixes produced
+        size_t chunks;      ///< chunks parsed
+        double seconds;     ///< wall time of the import
+    };
+
+    /**
+    * \param threads worker threads, 0 - one per core
+    * \param chunk_size approximate chunk size, bytes
+    */
+    explicit CNmeaImporter(unsigned threads = 0, size_t chunk_size = DEFAULT_CHUNK_SIZE) :
+        m_threads(threads ? threads : boost::thread::hardware_concurrency()),
+        m_chunkSize(chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE)
+    {
+        if(m_threads == 0)
+        {
+            m_threads = 1;
+        }
+        memset(&m_stats, 0, sizeof(m_stats));
+    };
+
+    /**
+    * Import a log file
+    * \param file_name log to map
+    * \param [out] fixes fixes in file order, replaces the contents
+    * \return number of fixes
+    * \throws std::ios_base::failure if the file cannot be mapped
+    */
+    size_t import(const std::string & file_name, std::vector<CGpsFix> & fixes)
+    {
+        boost::iostreams::mapped_file_source file(file_name);
+        return import(file.data(), file.size(), fixes);
+    };
+
+    /**
+    * Import a log in memory
+    * \param data log text, lines terminated with "\n" or "\r\n"
+    * \param size text size
+    * \param [out] fixes fixes in file order, replaces the contents
+    * \return number of fixes
+    */
+    size_t import(const char *data, size_t size, std::vector<CGpsFix> & fixes)
+    {
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+        std::vector<Chunk> chunks;
+        split(data, size, chunks);
+
+        // the pool runs until every chunk is parsed
+        boost::asio::io_service pool;
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            pool.post(boost::bind(&CNmeaImporter::parseChunk, &chunks[i]));
+        }
+        unsigned threads = std::min<size_t>(m_threads, chunks.size());
+        boost::thread_group workers;
+        for(unsigned i = 1; i < threads; i++)
+        {
+            workers.create_thread(boost::bind(&boost::asio::io_service::run, &pool));
+        }
+        pool.run();
+        workers.join_all();
+
+        merge(chunks, fixes);
+
+        m_stats.bytes = size;
+        m_stats.sentences = 0;
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            m_stats.sentences += chunks[i].sentences;
+        }
+        m_stats.fixes = fixes.size();
+        m_stats.chunks = chunks.size();
+        m_stats.seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+        return fixes.size();
+    };
+
+    /// \return statistics of the last import
+    const Stats & stats() const { return m_stats; };
+
+    /// \return number of worker threads
+    unsigned threads() const { return m_threads; };
+
+private:
+    /// Default chunk size, bytes
+    static const size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    /// Part of the log parsed by one task
+    struct Chunk
+    {
+        Chunk() : begin(NULL), end(NULL), lastWritten(0), sentences(0) {};
+
+        const char *begin;
+        const char *end;
+        std::vector<CGpsFix> fixes; ///< fixes, fields of the chunk only
+        std::vector<boost::uint32_t> written; ///< members written by the chunk up to each fix
+        CGpsFix last;               ///< parser state at the end of the chunk
+        boost::uint32_t lastWritten; ///< members written by the whole chunk
+        size_t sentences;
+    };
+
+    /// Split the log into chunks ending after a line terminator
+    void split(const char *data, size_t size, std::vector<Chunk> & chunks) const
+    {
+        const char *end = data + size;
+        for(const char *p = data; p < end; )
+        {
+            Chunk chunk;
+            chunk.begin = p;
+            if(static_cast<size_t>(end - p) <= m_chunkSize)
+            {
+                chunk.end = end;
+            }
+            else
+            {
+                const char *eol = static_cast<const char *>(memchr(p + m_chunkSize, '\n', end - p - m_chunkSize));
+                chunk.end = eol ? eol + 1 : end;
+            }
+            chunks.push_back(chunk);
+            p = chunk.end;
+        }
+    };
+
+    /// Parse one chunk, runs on a worker thread
+    static void parseChunk(Chunk *chunk)
+    {
+        CGps gps;
+        // recorded data has no arrival time, one clock read per chunk
+        CByteStream::Clock::time_point received = CByteStream::Clock::now();
+        const char *end = chunk->end;
+        for(const char *line = chunk->begin; line < end; )
+        {
+            const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+            const char *line_end = eol ? eol : end;
+            if(line_end - line > 1)
+            {
+                chunk->sentences++;
+                if(gps.parseSentence(line, line_end - line, received))
+                {
+                    chunk->fixes.push_back(gps.getFix());
+                    chunk->written.push_back(gps.getWritten());
+                }
+            }
+            line = line_end + 1;
+        }
+        chunk->last = gps.getFix();
+        chunk->lastWritten = gps.getWritten();
+    };
+
+    /// Join the chunk fixes in order, filling fields from the previous chunks
+    static void merge(const std::vector<Chunk> & chunks, std::vector<CGpsFix> & fixes)
+    {
+        size_t total = 0;
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            total += chunks[i].fixes.size();
+        }
+        fixes.clear();
+        fixes.reserve(total);
+
+        CGpsFix state;
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            const Chunk & chunk = chunks[i];
+            if(state.flags == 0)
+            {
+                fixes.insert(fixes.end(), chunk.fixes.begin(), chunk.fixes.end());
+            }
+            else
+            {
+                for(size_t k = 0; k < chunk.fixes.size(); k++)
+                {
+                    fixes.push_back(state);
+                    overlay(fixes.back(), chunk.fixes[k], chunk.written[k]);
+                }
+            }
+            overlay(state, chunk.last, chunk.lastWritten);
+        }
+    };
+
+    /// Copy the members written to a fix over a fix
+    static void overlay(CGpsFix & fix, const CGpsFix & update, boost::uint32_t written)
+    {
+        if(written & CGps::MEMBER_POSITION)
+        {
+            fix.latitude = update.latitude;
+            fix.longitude = update.longitude;
+        }
+        if(written & CGps::MEMBER_TIME) fix.time = update.time;
+        if(written & CGps::MEMBER_DATE)
+        {
+            fix.year = update.year;
+            fix.month = update.month;
+            fix.day = update.day;
+        }
+        if(written & CGps::MEMBER_SPEED) fix.speed = update.speed;
+        if(written & CGps::MEMBER_COURSE) fix.course = update.course;
+        if(written & CGps::MEMBER_ALTITUDE) fix.altitude = update.altitude;
+        if(written & CGps::MEMBER_QUALITY)
+        {
+            fix.quality = update.quality;
+            fix.satellites = update.satellites;
+        }
+        if(written & CGps::MEMBER_HDOP) fix.hdop = update.hdop;
+        if(written & CGps::MEMBER_MODE) fix.mode = update.mode;
+        if(written & CGps::MEMBER_PDOP) fix.pdop = update.pdop;
+        if(written & CGps::MEMBER_VDOP) fix.vdop = update.vdop;
+        if(written & CGps::MEMBER_IN_VIEW) fix.satellitesInView = update.satellitesInView;
+        if(written & CGps::MEMBER_LAT_ERROR) fix.latError = update.latError;
+        if(written & CGps::MEMBER_LON_ERROR) fix.lonError = update.lonError;
+        if(written & CGps::MEMBER_ALT_ERROR) fix.altError = update.altError;
+        if(written & CGps::MEMBER_VALID) fix.valid = update.valid;
+        fix.flags |= update.flags;
+        fix.received = update.received;
+    };
+
+    unsigned m_threads;
+    size_t m_chunkSize;
+    Stats m_stats;
+};
+
+#endif // __CNMEAIMPORTER_H__
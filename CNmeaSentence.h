@@ -0,0 +1,72 @@
+#ifndef __CNMEASENTENCE_H__
+#define __CNMEASENTENCE_H__
+
+#include <cstring>
+
+#include "CNmeaField.h"
+#include "CNmeaChecksum.h"
+
+// --------------------------------------------
+/// NMEA 0183 sentence tokenizer.
+/// Walks "$ttsss,f1,f2,...*hh" in place: validates the checksum and splits
+/// the fields into views of the original buffer. Nothing is allocated, the
+/// buffer must outlive the views.
+class CNmeaSentence
+{
+public:
+    /// Fields kept, the rest of a longer sentence is ignored
+    enum { MAX_FIELDS = 40 };
+
+    CNmeaSentence() : m_count(0) {};
+
+    /**
+    * Tokenize a sentence. Characters before '$' are skipped.
+    * \param data sentence text, may include the line terminator
+    * \param size text size
+    * \return true if the sentence is well formed and its checksum is valid
+    */
+    bool parse(const char *data, size_t size)
+    {
+        m_count = 0;
+        const char *end = data + size;
+        const char *p = static_cast<const char *>(memchr(data, '$', size));
+        const char *star;
+        if(!p || !CNmeaChecksum::validate(p, end - p, &star))
+        {
+            return false;
+        }
+
+        // fields between '$' and '*', field 0 is the address "GPRMC"
+        const char *field = p + 1;
+        for(;;)
+        {
+            const char *comma = static_cast<const char *>(memchr(field, ',', star - field));
+            const char *field_end = comma ? comma : star;
+            if(m_count < MAX_FIELDS)
+            {
+                m_fields[m_count++] = CNmeaField(field, field_end - field);
+            }
+            if(!comma)
+            {
+                break;
+            }
+            field = comma + 1;
+        }
+        return true;
+    };
+
+    /// \return number of fields, including the address field
+    size_t count() const { return m_count; };
+
+    /// \return field i, empty view if absent
+    CNmeaField operator[](size_t i) const { return i < m_count ? m_fields[i] : CNmeaField(); };
+
+    /// \return address field, e.g. "GPRMC"
+    CNmeaField address() const { return (*this)[0]; };
+
+private:
+    CNmeaField m_fields[MAX_FIELDS];
+    size_t m_count;
+};
+
+#endif // __CNMEASENTENCE_H__
@@ -0,0 +1,248 @@
+#ifndef __CPTYLOOPBACK_H__
+#define __CPTYLOOPBACK_H__
+
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pty.h>
+#include <boost/utility.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+// --------------------------------------------
+/// Pseudo-terminal loopback fixture.
+/// Emulates a serial device without hardware: CUart opens the slave side
+/// by name (getSlaveName()), the fixture injects byte streams into the
+/// master side at a configurable rate and burst pattern, and reads back
+/// what CUart wrote. Linux/POSIX only.
+class CPtyLoopback : private boost::noncopyable
+{
+public:
+    CPtyLoopback() : m_master(-1), m_slave(-1), m_running(false), m_injected(0), m_responding(false)
+    {
+        char name[64];
+        if(openpty(&m_master, &m_slave, name, NULL, NULL) != 0)
+        {
+            throw std::runtime_error(std::string("openpty: ") + strerror(errno));
+        }
+        m_slave_name = name;
+
+        // raw master: no echo, no line discipline on the device side
+        struct termios tio;
+        tcgetattr(m_slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(m_slave, TCSANOW, &tio);
+    };
+
+    virtual ~CPtyLoopback()
+    {
+        stopInjection();
+        stopResponder();
+        if(m_slave >= 0) ::close(m_slave);
+        if(m_master >= 0) ::close(m_master);
+    };
+
+    /// Device name to open with CUart
+    const std::string & getSlaveName() const { return m_slave_name; };
+
+    /// Master side descriptor
+    int getMasterFd() const { return m_master; };
+
+    /**
+    * Write data to the device side, as if the device sent it
+    * \return number of bytes written, -1 on error
+    */
+    ssize_t inject(const char *data, size_t size)
+    {
+        size_t done = 0;
+        while(done < size)
+        {
+            ssize_t rc = ::write(m_master, data + done, size - done);
+            if(rc < 0)
+            {
+                if(errno == EINTR || errno == EAGAIN) continue;
+                return -1;
+            }
+            done += rc;
+        }
+        m_injected += done;
+        return done;
+    };
+
+    ssize_t inject(const std::string & s) { return inject(s.data(), s.size()); };
+
+    /**
+    * Start injecting data from a thread.
+    * The pattern is repeated until total bytes are injected. Bytes go out in
+    * bursts of burst_size, paced to the average rate.
+    * \param pattern data repeated in the stream
+    * \param total bytes to inject
+    * \param rate average rate, bytes/sec, 0 - as fast as the pty accepts
+    * \param burst_size bytes written at once, 0 - whole pattern
+    */
+    void startInjection(const std::string & pattern, size_t total, size_t rate = 0, size_t burst_size = 0)
+    {
+        stopInjection();
+        m_pattern = pattern;
+        m_running = true;
+        m_thread = boost::thread(boost::bind(&CPtyLoopback::injectLoop, this, total, rate,
+                                             burst_size ? burst_size : pattern.size()));
+    };
+
+    /// Stop injection thread
+    void stopInjection()
+    {
+        m_running = false;
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    };
+
+    /// Wait until injection thread finished
+    void waitInjection()
+    {
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    };
+
+    /// Bytes injected so far
+    size_t getInjectedBytes() const { return m_injected; };
+
+    /**
+    * Read what CUart wrote to the device
+    * \param timeout_ms wait for data at most, msec
+    * \return number of bytes read, 0 on timeout
+    */
+    size_t receive(char *data, size_t size, int timeout_ms)
+    {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(m_master, &rfds);
+        struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        if(select(m_master + 1, &rfds, NULL, NULL, &tv) <= 0)
+        {
+            return 0;
+        }
+        ssize_t rc = ::read(m_master, data, size);
+        return rc > 0 ? rc : 0;
+    };
+
+    /// Device emulation: returns the reply to a request received from CUart
+    typedef boost::function<std::string (const std::string & request)> Responder;
+
+    /**
+    * Start answering requests from a thread, as a command/response device
+    * (e.g. ELM327) does. Each request is the data CUart wrote up to the
+    * delimiter, delimiter and line feeds removed.
+    * \param responder function producing the reply
+    * \param delim request delimiter
+    * \param delay_us device processing time before the reply, usec
+    */
+    void startResponder(const Responder & responder, char delim = '\r', unsigned delay_us = 0)
+    {
+        stopResponder();
+        m_responding = true;
+        m_resp_thread = boost::thread(boost::bind(&CPtyLoopback::respondLoop, this, responder, delim, delay_us));
+    };
+
+    /// Stop responder thread
+    void stopResponder()
+    {
+        m_responding = false;
+        if(m_resp_thread.joinable())
+        {
+            m_resp_thread.join();
+        }
+    };
+
+private:
+    /// Responder thread body
+    void respondLoop(Responder responder, char delim, unsigned delay_us)
+    {
+        std::string request;
+        char buf[256];
+        while(m_responding)
+        {
+            size_t n = receive(buf, sizeof(buf), 50);
+            for(size_t i = 0; i < n; i++)
+            {
+                if(buf[i] == '\n')
+                {
+                    continue;
+                }
+                if(buf[i] != delim)
+                {
+                    request += buf[i];
+                    continue;
+                }
+                if(delay_us)
+                {
+                    usleep(delay_us);
+                }
+                inject(responder(request));
+                request.clear();
+            }
+        }
+    };
+
+    /// Injection thread body
+    void injectLoop(size_t total, size_t rate, size_t burst_size)
+    {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        size_t sent = 0, pos = 0;
+        std::string burst;
+        while(m_running && sent < total)
+        {
+            // assemble next burst from the repeated pattern
+            burst.clear();
+            size_t n = std::min(burst_size, total - sent);
+            while(burst.size() < n)
+            {
+                size_t k = std::min(n - burst.size(), m_pattern.size() - pos);
+                burst.append(m_pattern, pos, k);
+                pos = (pos + k) % m_pattern.size();
+            }
+            if(inject(burst) < 0)
+            {
+                break;
+            }
+            sent += n;
+
+            if(rate)
+            {
+                // sleep until this burst is due at the average rate
+                double due = (double)sent / rate;
+                struct timespec t;
+                clock_gettime(CLOCK_MONOTONIC, &t);
+                double now = (t.tv_sec - t0.tv_sec) + (t.tv_nsec - t0.tv_nsec) * 1e-9;
+                if(due > now)
+                {
+                    usleep((useconds_t)((due - now) * 1e6));
+                }
+            }
+        }
+        m_running = false;
+    };
+
+    int m_master;
+    int m_slave;
+    std::string m_slave_name;
+    std::string m_pattern;
+    boost::thread m_thread;
+    boost::atomic<bool> m_running;
+    boost::atomic<size_t> m_injected;
+    boost::thread m_resp_thread;
+    boost::atomic<bool> m_responding;
+};
+
+#endif // __CPTYLOOPBACK_H__
@@ -4,19 +4,52 @@
 #include <algorithm>
 #include <iostream>
 #include <boost/bind.hpp>
+#ifdef __linux__
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
 
 using namespace std;
 using namespace boost;
 
-CUart::CUart(): io(), port(io), timer(io),
-        timeout(posix_time::milliseconds(0)) {}
+CUart::CUart(): ownIo(new asio::io_service()), io(*ownIo), port(io), strand(io),
+        timer(io), timeout(posix_time::milliseconds(0)), setupLevel(0),
+        asyncLevel(0), lowLatency(false), lowLatencyApplied(false),
+        savedVmin(0), savedVtime(0), savedLowLatencyFlag(-1),
+        rxRetryTimer(io), rxRunning(false), rxError(false), rxChunkSize(0),
+        rxChunkPos(0), rxScanPos(0), rxPushed(0), rxPulled(0), asyncTimer(io), asyncTimedOut(false),
+        readPending(false), timerPending(false),
+        txPendingCount(0), txPendingBytes(0), txInFlightCount(0),
+        txInFlightBytes(0), txBusy(false), txWritten(0), txCancels(0),
+        cancelCount(0) {}
+
+CUart::CUart(asio::io_service& ios): io(ios), port(io), strand(io),
+        timer(io), timeout(posix_time::milliseconds(0)), setupLevel(0),
+        asyncLevel(0), lowLatency(false), lowLatencyApplied(false),
+        savedVmin(0), savedVtime(0), savedLowLatencyFlag(-1),
+        rxRetryTimer(io), rxRunning(false), rxError(false), rxChunkSize(0),
+        rxChunkPos(0), rxScanPos(0), rxPushed(0), rxPulled(0), asyncTimer(io), asyncTimedOut(false),
+        readPending(false), timerPending(false),
+        txPendingCount(0), txPendingBytes(0), txInFlightCount(0),
+        txInFlightBytes(0), txBusy(false), txWritten(0), txCancels(0),
+        cancelCount(0) {}
 
 CUart::CUart(const std::string& devname, unsigned int baud_rate,
         asio::serial_port_base::parity opt_parity,
         asio::serial_port_base::character_size opt_csize,
         asio::serial_port_base::flow_control opt_flow,
         asio::serial_port_base::stop_bits opt_stop)
-        : io(), port(io), timer(io), timeout(posix_time::milliseconds(0))
+        : ownIo(new asio::io_service()), io(*ownIo), port(io), strand(io),
+        timer(io), timeout(posix_time::milliseconds(0)), setupLevel(0),
+        asyncLevel(0), lowLatency(false), lowLatencyApplied(false),
+        savedVmin(0), savedVtime(0), savedLowLatencyFlag(-1),
+        rxRetryTimer(io), rxRunning(false), rxError(false), rxChunkSize(0),
+        rxChunkPos(0), rxScanPos(0), rxPushed(0), rxPulled(0), asyncTimer(io), asyncTimedOut(false),
+        readPending(false), timerPending(false),
+        txPendingCount(0), txPendingBytes(0), txInFlightCount(0),
+        txInFlightBytes(0), txBusy(false), txWritten(0), txCancels(0),
+        cancelCount(0)
 //       , readData(m_binremove_filter)
 {
     open(devname,baud_rate,opt_parity,opt_csize,opt_flow,opt_stop);
@@ -35,6 +68,8 @@ void CUart::open(const std::string& devname, unsigned int baud_rate,
     port.set_option(opt_csize);
     port.set_option(opt_flow);
     port.set_option(opt_stop);
+    lowLatencyApplied=false;
+    if(lowLatency) applyLowLatency();
 }
 
 void CUart::open(const std::string& devname, 
@@ -56,6 +91,8 @@ void CUart::open(const std::string& devname,
     port.set_option(opt_csize);
     port.set_option(opt_flow);
     port.set_option(opt_stop);
+    lowLatencyApplied=false;
+    if(lowLatency) applyLowLatency();
 }
 
 bool CUart::isOpen() const
@@ -63,8 +100,64 @@ bool CUart::isOpen() const
     return port.is_open();
 }
 
+void CUart::setLowLatency(bool on)
+{
+    lowLatency=on;
+    if(isOpen()) applyLowLatency();
+}
+
+bool CUart::isLowLatency() const
+{
+#ifdef __linux__
+    struct serial_struct ss;
+    if(isOpen() && ioctl(const_cast<asio::serial_port&>(port).native_handle(),
+            TIOCGSERIAL,&ss)==0)
+    {
+        return (ss.flags & ASYNC_LOW_LATENCY)!=0;
+    }
+#endif
+    return false;
+}
+
+void CUart::applyLowLatency()
+{
+#ifdef __linux__
+    if(!lowLatency && !lowLatencyApplied) return;
+    int fd=port.native_handle();
+    struct termios tio;
+    struct serial_struct ss;
+    if(lowLatency && !lowLatencyApplied)
+    {
+        //Save what the profile changes, for switching it off
+        if(tcgetattr(fd,&tio)==0)
+        {
+            savedVmin=tio.c_cc[VMIN];
+            savedVtime=tio.c_cc[VTIME];
+        }
+        savedLowLatencyFlag=-1;
+        if(ioctl(fd,TIOCGSERIAL,&ss)==0)
+            savedLowLatencyFlag=(ss.flags & ASYNC_LOW_LATENCY)!=0;
+    }
+    if(tcgetattr(fd,&tio)==0)
+    {
+        tio.c_cc[VMIN]=lowLatency ? 1 : savedVmin;
+        tio.c_cc[VTIME]=lowLatency ? 0 : savedVtime;
+        tcsetattr(fd,TCSANOW,&tio);
+    }
+    // Not a real serial driver (pty, some USB CDC) - ENOTTY, skip
+    if(savedLowLatencyFlag>=0 && ioctl(fd,TIOCGSERIAL,&ss)==0)
+    {
+        if(lowLatency || savedLowLatencyFlag) ss.flags|=ASYNC_LOW_LATENCY;
+        else ss.flags&=~ASYNC_LOW_LATENCY;
+        ioctl(fd,TIOCSSERIAL,&ss);
+    }
+    lowLatencyApplied=lowLatency;
+#endif
+}
+
 void CUart::close()
 {
+    stopReader();
     if(isOpen()==false) return;
     port.close();
 }
@@ -76,66 +169,182 @@ void CUart::setTimeout(const posix_time::time_duration& t)
 
 void CUart::write(const char *data, size_t size)
 {
-    asio::write(port,asio::buffer(data,size));
+    writeGather(asio::buffer(data,size));
 }
 
 void CUart::write(const std::vector<char>& data)
 {
-    asio::write(port,asio::buffer(&data[0],data.size()));
+    writeGather(asio::buffer(&data[0],data.size()));
 }
 
 void CUart::writeString(const std::string& s)
 {
-    asio::write(port,asio::buffer(s.c_str(),s.size()));
+    writeGather(asio::buffer(s.c_str(),s.size()));
 }
 
-int CUart::read(char *data, size_t size)
+void CUart::writeLine(const std::string& s, const std::string& eol)
 {
-    if(readData.size()>0)//If there is some data from a previous read
+    boost::array<asio::const_buffer,2> bufs=
+    {{
+        asio::buffer(s),
+        asio::buffer(eol)
+    }};
+    writeGather(bufs);
+}
+
+size_t CUart::queueWrite(const char *data, size_t size)
+{
+    boost::mutex::scoped_lock lock(txMutex);
+    if(txPendingCount==txPending.size()) txPending.push_back(std::string());
+    txPending[txPendingCount++].assign(data,size);
+    txPendingBytes+=size;
+    return txPendingBytes+txInFlightBytes;
+}
+
+size_t CUart::queueWriteString(const std::string& s)
+{
+    return queueWrite(s.data(),s.size());
+}
+
+size_t CUart::getQueueDepth() const
+{
+    boost::mutex::scoped_lock lock(txMutex);
+    return txPendingBytes+txInFlightBytes;
+}
+
+bool CUart::prepareFlush()
+{
+    boost::mutex::scoped_lock lock(txMutex);
+    if(txPendingCount==0) return false;
+    // Swap queues, so new fragments may be queued during the write
+    txInFlight.swap(txPending);
+    txInFlightCount=txPendingCount;
+    txInFlightBytes=txPendingBytes;
+    txPendingCount=txPendingBytes=0;
+    txBuffers.clear();
+    for(size_t i=0;i<txInFlightCount;i++)
     {
-        istream is(&readData);
-        size_t toRead=min(readData.size(),size);//How many bytes to read?
-        is.read(data,toRead);
-        data+=toRead;
-        size-=toRead;
-        if(size>=0) return resultSuccess;//If read data was enough, just return
+        txBuffers.push_back(asio::buffer(txInFlight[i]));
     }
-    
-    setupParameters=ReadSetupParameters(data,size);
-    performReadSetup(setupParameters);
+    return true;
+}
 
-    //For this code to work, there should always be a timeout, so the
-    //request for no timeout is translated into a very long timeout
-    if(timeout != posix_time::milliseconds(0)) timer.expires_from_now(timeout);
-    else timer.expires_from_now(posix_time::hours(100000));
-    
-    timer.async_wait(boost::bind(&CUart::timeoutExpired,this,
-                asio::placeholders::error));
-    
-    result=resultInProgress;
-    bytesTransferred=0;
-    for(;;)
+void CUart::flush()
+{
+    if(!prepareFlush()) return;
+    try {
+        writeGather(txBuffers);
+    } catch(...) {
+        boost::mutex::scoped_lock lock(txMutex);
+        txInFlightCount=txInFlightBytes=0;
+        throw;
+    }
+    boost::mutex::scoped_lock lock(txMutex);
+    txInFlightCount=txInFlightBytes=0;
+}
+
+void CUart::asyncFlush(const WriteHandler& handler)
+{
+    {
+        boost::mutex::scoped_lock lock(txMutex);
+        if(handler) txHandlers.push_back(handler);
+        if(txBusy) return;//Pending fragments follow the write in progress
+        txBusy=true;
+    }
+    asyncFlushSetup();
+}
+
+void CUart::asyncFlushSetup()
+{
+    if(!prepareFlush())
+    {
+        //Never call the handlers from inside asyncFlush()
+        io.post(strand.wrap(boost::bind(&CUart::asyncFlushDone,this,
+                static_cast<int>(resultSuccess),static_cast<size_t>(0))));
+        return;
+    }
+    txStart=CUartCounters::Clock::now();
+    txWritten=0;
+    txCancels=cancelCount;
+    asyncFlushWrite();
+}
+
+void CUart::asyncFlushWrite()
+{
+    asio::async_write(port,txBuffers,strand.wrap(boost::bind(
+            &CUart::asyncFlushCompleted,this,asio::placeholders::error,
+            asio::placeholders::bytes_transferred)));
+}
+
+void CUart::asyncFlushCompleted(const boost::system::error_code& error,
+        const size_t bytesTransferred)
+{
+    txWritten+=bytesTransferred;
+    if(abortedByRead(error,txCancels) && txWritten<txInFlightBytes)
+    {
+        //Drop the written part from the gather list, write the rest
+        size_t skip=bytesTransferred;
+        size_t i=0;
+        while(i<txBuffers.size() && skip>=asio::buffer_size(txBuffers[i]))
+        {
+            skip-=asio::buffer_size(txBuffers[i++]);
+        }
+        txBuffers.erase(txBuffers.begin(),txBuffers.begin()+i);
+        if(!txBuffers.empty()) txBuffers[0]=txBuffers[0]+skip;
+        asyncFlushWrite();
+        return;
+    }
+    stats.writeDone(txStart,!error,txWritten);
     {
-        io.run_one();
-        switch(result)
+        boost::mutex::scoped_lock lock(txMutex);
+        txInFlightCount=txInFlightBytes=0;
+        if(!error && txPendingCount>0)
         {
-            case resultSuccess:
-                timer.cancel();
-                return result;
-            case resultTimeoutExpired:
-                port.cancel();
-                //throw(timeout_exception("Timeout expired"));
-                return result;
-            case resultError:
-                timer.cancel();
-                port.cancel();
-                //throw(boost::system::system_error(boost::system::error_code(), "Error while reading"));
-                return result;
-            default:
-                //if resultInProgress remain in the loop
-                break;
+            lock.unlock();
+            asyncFlushSetup();
+            return;
         }
     }
+    asyncFlushDone(error ? resultError : resultSuccess,txWritten);
+}
+
+void CUart::asyncFlushDone(int result, size_t bytesTransferred)
+{
+    // Handlers may start the next flush, which adds to txHandlers
+    std::vector<WriteHandler> handlers;
+    {
+        boost::mutex::scoped_lock lock(txMutex);
+        txBusy=false;
+        handlers.swap(txHandlers);
+    }
+    for(size_t i=0;i<handlers.size();i++) handlers[i](result,bytesTransferred);
+}
+
+int CUart::read(char *data, size_t size)
+{
+    CUartCounters::Clock::time_point start=CUartCounters::Clock::now();
+    int rc=rxRing ? readFromRing(data,size) : readDirect(data,size);
+    if(rc==resultSuccess) readTime=rxRing ? receiveTime(readData.size()) : rxTime;
+    stats.readDone(start,rc==resultSuccess,rc==resultTimeoutExpired,
+            rc==resultSuccess ? size : 0,0);
+    return rc;
+}
+
+int CUart::readDirect(char *data, size_t size)
+{
+    //Drain readahead left by previous line reads first
+    size_t got=readData.sgetn(data,size);
+    if(got==size) return resultSuccess;
+
+    //Read the remainder straight into the destination
+    int rc=performRead(ReadSetupParameters(data+got,size-got),readDeadline());
+    if(rc!=resultSuccess && got+bytesTransferred>0)
+    {
+        //Keep the readahead and the partially read bytes for the next
+        //read, so that the stream does not lose sync on timeout
+        readData.sputn(data,got+bytesTransferred);
+    }
+    return rc;
 }
 
 std::vector<char> CUart::read(size_t size)
@@ -147,74 +356,511 @@ std::vector<char> CUart::read(size_t size)
 
 int CUart::readString(std::string &out)
 {
-   out.assign(out.capacity(), '\0');
-    return read(&out[0], out.size());//Fill it with values
+    //Grows only once, a string of full capacity is reused as is
+    if(out.size()<out.capacity()) out.resize(out.capacity());
+    if(out.empty()) return resultSuccess;
+    return read(&out[0],out.size());//Fill it with values
 }
 
 int CUart::readStringUntil(std::string &out, const std::string& delim)
 {
+    CUartCounters::Clock::time_point start=CUartCounters::Clock::now();
+    size_t lineSize=0;
+    int rc=waitLine(delim,lineSize,readDeadline());
+    stats.readDone(start,rc==resultSuccess,rc==resultTimeoutExpired,
+            lineSize,1);
+    if(rc==resultSuccess)
+    {
+        appendPrintable(out,lineData(),lineSize-delim.size());
+        readData.consume(lineSize);//Remove line and delimiter from stream
+    }
+    return rc;
+}
+
+int CUart::readLine(char *data, size_t size, size_t &len,
+        const std::string& delim)
+{
+    CUartCounters::Clock::time_point start=CUartCounters::Clock::now();
+    len=0;
+    size_t lineSize=0;
+    int rc=waitLine(delim,lineSize,readDeadline());
+    stats.readDone(start,rc==resultSuccess,rc==resultTimeoutExpired,
+            lineSize,1);
+    if(rc==resultSuccess)
+    {
+        len=copyPrintable(data,size,lineData(),lineSize-delim.size());
+        readData.consume(lineSize);//Remove line and delimiter from stream
+    }
+    return rc;
+}
+
+int CUart::readFilteredLine(std::string &out, const std::string& delim,
+        const LineFilter& filter, size_t &skipped)
+{
+    boost::system_time deadline=readDeadline();
+    for(;;)
+    {
+        CUartCounters::Clock::time_point start=CUartCounters::Clock::now();
+        size_t lineSize=0;
+        //Each wait gets the time left, the timeout covers the whole call
+        int rc=waitLine(delim,lineSize,deadline);
+        stats.readDone(start,rc==resultSuccess,rc==resultTimeoutExpired,
+                lineSize,1);
+        if(rc!=resultSuccess) return rc;
+        const char *line=lineData();
+        size_t len=lineSize-delim.size();
+        if(filter.accept(line,len))
+        {
+            appendPrintable(out,line,len);
+            readData.consume(lineSize);
+            return rc;
+        }
+        readData.consume(lineSize);//Rejected, dropped without copying
+        skipped++;
+        //Buffered lines complete without waiting, stop on a steady stream
+        if(boost::get_system_time()>=deadline) return resultTimeoutExpired;
+    }
+}
+
+int CUart::waitLine(const std::string& delim, size_t &lineSize,
+        const boost::system_time& deadline)
+{
+    rxScanPos=0;
+    if(rxRing)
+    {
+        int rc=readLineFromRing(delim,lineSize,deadline);
+        if(rc==resultSuccess) readTime=receiveTime(readData.size()-lineSize);
+        return rc;
+    }
+
     // Note: if readData contains some previously read data, the call to
     // async_read_until (which is done in performReadSetup) correctly handles
     // it. If the data is enough it will also immediately call readCompleted()
-    setupParameters=ReadSetupParameters(delim);
+    int rc=performRead(ReadSetupParameters(delim),deadline);
+    if(rc==resultSuccess)
+    {
+        lineSize=bytesTransferred;
+        readTime=rxTime;
+        stats.rxLevel(readData.size());
+    }
+    return rc;
+}
+
+int CUart::performRead(const ReadSetupParameters& param,
+        const boost::system_time& deadline)
+{
+    //Own io stops when the previous read left no work, restart it
+    if(ownIo) io.reset();
+    setupParameters=param;
+    result=resultInProgress;
+    bytesTransferred=0;
     performReadSetup(setupParameters);
 
-    //For this code to work, there should always be a timeout, so the
-    //request for no timeout is translated into a very long timeout
-    if(timeout != posix_time::milliseconds(0)) timer.expires_from_now(timeout);
-    else timer.expires_from_now(posix_time::hours(100000));
+    //Data already received completes the read without arming the timer
+    while(result==resultInProgress && io.poll_one()) {}
+
+    if(result==resultInProgress)
+    {
+        //For this code to work, there should always be a timeout, the
+        //deadline of no timeout is very far, see readDeadline()
+        timer.expires_at(deadline);
+
+        timerPending=true;
+        timer.async_wait(boost::bind(&CUart::timeoutExpired,this,
+                    asio::placeholders::error));
+
+        while(result==resultInProgress) io.run_one();
+
+        if(result==resultTimeoutExpired) port.cancel();
+        else timer.cancel();
+    }
+
+    //Run the handlers of the canceled operations now, otherwise they would
+    //complete the next read with a stale result
+    while(readPending || timerPending) io.run_one();
+    return result;
+}
+
+void CUart::asyncReadStringUntil(const std::string& delim,
+        const ReadHandler& handler)
+{
+    asyncDelim=delim;
+    asyncHandler=handler;
+    asyncTimedOut=false;
+    asyncStart=CUartCounters::Clock::now();
+    asyncLevel=readData.size();
+    asio::async_read_until(port,readData,asyncDelim,strand.wrap(boost::bind(
+            &CUart::asyncReadCompleted,this,asio::placeholders::error,
+            asio::placeholders::bytes_transferred)));
+    if(timeout != posix_time::milliseconds(0))
+    {
+        asyncTimer.expires_from_now(timeout);
+        asyncTimer.async_wait(strand.wrap(boost::bind(
+                &CUart::asyncTimeoutExpired,this,asio::placeholders::error)));
+    }
+}
+
+void CUart::asyncReadCompleted(const boost::system::error_code& error,
+        const size_t bytesTransferred)
+{
+    #ifdef __APPLE__
+    if(error.value()==45)
+    {
+        //Bug on OS X, it might be necessary to repeat the setup
+        asio::async_read_until(port,readData,asyncDelim,strand.wrap(boost::bind(
+                &CUart::asyncReadCompleted,this,asio::placeholders::error,
+                asio::placeholders::bytes_transferred)));
+        return;
+    }
+    #endif //__APPLE__
+    asyncTimer.cancel();
+    if(readData.size()>asyncLevel) rxTime=Clock::now();
+    stats.readDone(asyncStart,!error,asyncTimedOut,bytesTransferred,1);
+    // Handler may start the next read, which replaces asyncHandler
+    ReadHandler handler;
+    handler.swap(asyncHandler);
+    asyncLine.clear();
+    if(!error)
+    {
+        readTime=rxTime;
+        stats.rxLevel(readData.size());
+        appendPrintable(asyncLine,lineData(),bytesTransferred-asyncDelim.size());
+        readData.consume(bytesTransferred);//Remove line and delimiter
+        if(handler) handler(resultSuccess,asyncLine);
+        return;
+    }
+    if(handler) handler(asyncTimedOut ? resultTimeoutExpired : resultError,
+            asyncLine);
+}
+
+void CUart::asyncTimeoutExpired(const boost::system::error_code& error)
+{
+    // Skip if the read completed and a new one re-armed the timer
+    if(error || asyncTimer.expires_at() > asio::deadline_timer::traits_type::now())
+        return;
+    asyncTimedOut=true;
+    //Cancels the writes in progress as well, they are resumed, see
+    //abortedByRead()
+    port.cancel();
+}
+
+void CUart::asyncWrite(const char *data, size_t size,
+        const WriteHandler& handler)
+{
+    boost::shared_ptr<AsyncWrite> op(new AsyncWrite);
+    op->handler=handler;
+    op->data=data;
+    op->size=size;
+    op->done=0;
+    op->start=CUartCounters::Clock::now();
+    op->cancels=cancelCount;
+    asyncWriteSetup(op);
+}
+
+void CUart::asyncWriteString(const std::string& s,
+        const WriteHandler& handler)
+{
+    boost::shared_ptr<AsyncWrite> op(new AsyncWrite);
+    op->handler=handler;
+    op->keep=s;
+    op->data=op->keep.data();
+    op->size=op->keep.size();
+    op->done=0;
+    op->start=CUartCounters::Clock::now();
+    op->cancels=cancelCount;
+    asyncWriteSetup(op);
+}
+
+void CUart::asyncWriteSetup(boost::shared_ptr<AsyncWrite> op)
+{
+    asio::async_write(port,asio::buffer(op->data+op->done,op->size-op->done),
+            strand.wrap(boost::bind(&CUart::asyncWriteCompleted,this,op,
+            asio::placeholders::error,asio::placeholders::bytes_transferred)));
+}
+
+void CUart::asyncWriteCompleted(boost::shared_ptr<AsyncWrite> op,
+        const boost::system::error_code& error,
+        const size_t bytesTransferred)
+{
+    op->done+=bytesTransferred;
+    if(abortedByRead(error,op->cancels) && op->done<op->size)
+    {
+        asyncWriteSetup(op);
+        return;
+    }
+    stats.writeDone(op->start,!error,op->done);
+    if(op->handler) op->handler(error ? resultError : resultSuccess,op->done);
+}
+
+bool CUart::abortedByRead(const boost::system::error_code& error,
+        unsigned cancels) const
+{
+    return error==asio::error::operation_aborted && cancels==cancelCount &&
+            isOpen();
+}
+
+void CUart::cancel()
+{
+    cancelCount++;
+    strand.dispatch(boost::bind(&CUart::doCancel,this));
+}
+
+void CUart::doCancel()
+{
+    asyncTimer.cancel();
+    port.cancel();
+}
+
+asio::io_service& CUart::getIoService()
+{
+    return io;
+}
+
+CByteStream::Clock::time_point CUart::getReceiveTime() const
+{
+    return readTime;
+}
+
+void CUart::getStats(CUartStats& out) const
+{
+    stats.snapshot(out);
+}
+
+void CUart::resetStats()
+{
+    stats.reset();
+}
+
+const char *CUart::lineData() const
+{
+    // asio::streambuf keeps its input sequence in one contiguous buffer
+    return asio::buffer_cast<const char*>(readData.data());
+}
+
+void CUart::startReader(size_t ring_size)
+{
+    if(rxRunning) return;
+    if(isOpen()==false)
+        throw(boost::system::system_error(
+                asio::error::make_error_code(asio::error::not_connected),
+                "Serial port is not open"));
+    if(!ownIo)
+        throw(boost::system::system_error(
+                asio::error::make_error_code(asio::error::operation_not_supported),
+                "Background reader needs own io_service"));
+
+    rxRing.reset(new lockfree::spsc_queue<char>(ring_size));
+    rxStamps.reset(new lockfree::spsc_queue<RxStamp>(READER_STAMPS));
+    rxError=false;
+    rxChunkSize=rxChunkPos=0;
+    rxPushed=rxPulled=0;
+    rxStampCur.end=0;
+    rxStampCur.time=rxTime;
+    rxRunning=true;
+
+    io.reset();
+    readerSetup();
+    rxThread=boost::thread(boost::bind(&asio::io_service::run,&io));
+}
+
+void CUart::stopReader()
+{
+    if(!rxRunning) return;
+    rxRunning=false;
+    io.stop();
+    rxThread.join();
+    // Drop the aborted read, so blocking reads may run io again
+    port.cancel();
+    rxRetryTimer.cancel();
+    io.reset();
+    io.poll();
+    io.reset();
+    // Keep what was received for the next (blocking) read, stamped with
+    // the arrival of its last chunk
+    pullRing();
+    RxStamp s;
+    while(rxStamps->pop(s)) rxStampCur=s;
+    rxTime=rxStampCur.time;
+    rxRing.reset();
+    rxStamps.reset();
+    rxCond.notify_all();
+}
+
+bool CUart::isReaderRunning() const
+{
+    return rxRunning;
+}
+
+void CUart::readerSetup()
+{
+    port.async_read_some(asio::buffer(rxChunk,sizeof(rxChunk)),boost::bind(
+            &CUart::readerCompleted,this,asio::placeholders::error,
+            asio::placeholders::bytes_transferred));
+}
+
+void CUart::readerCompleted(const boost::system::error_code& error,
+        const size_t bytesTransferred)
+{
+    if(error)
+    {
+        #ifdef __APPLE__
+        if(error.value()==45)
+        {
+            //Bug on OS X, it might be necessary to repeat the setup
+            readerSetup();
+            return;
+        }
+        #endif //__APPLE__
+        if(error!=asio::error::operation_aborted) rxError=true;
+        boost::mutex::scoped_lock lock(rxMutex);
+        rxCond.notify_all();
+        return;
+    }
+    rxChunkSize=bytesTransferred;
+    rxChunkPos=0;
+    rxChunkTime=Clock::now();
+    readerPush(boost::system::error_code());
+}
 
-    timer.async_wait(boost::bind(&CUart::timeoutExpired,this,
+void CUart::readerPush(const boost::system::error_code& error)
+{
+    size_t n=std::min(rxRing->write_available(),rxChunkSize-rxChunkPos);
+    if(n>0)
+    {
+        // The stamp goes first, so the consumer finds it with the data.
+        // If the stamp queue is full the data takes the next chunk's time
+        rxPushed+=n;
+        RxStamp stamp={rxPushed,rxChunkTime};
+        rxStamps->push(stamp);
+        rxChunkPos+=rxRing->push(rxChunk+rxChunkPos,n);
+    }
+    {
+        boost::mutex::scoped_lock lock(rxMutex);
+        rxCond.notify_all();
+    }
+    if(error || !rxRunning) return;
+    if(rxChunkPos<rxChunkSize)
+    {
+        // Ring is full: leave the rest in the device until consumer reads
+        rxRetryTimer.expires_from_now(posix_time::milliseconds(1));
+        rxRetryTimer.async_wait(boost::bind(&CUart::readerPush,this,
                 asio::placeholders::error));
+        return;
+    }
+    readerSetup();
+}
 
-    result=resultInProgress;
-    bytesTransferred=0;
+size_t CUart::pullRing()
+{
+    size_t avail=rxRing->read_available();
+    if(avail==0) return 0;
+    stats.rxLevel(readData.size()+avail);
+    asio::streambuf::mutable_buffers_type bufs=readData.prepare(avail);
+    size_t moved=0;
+    for(asio::streambuf::mutable_buffers_type::const_iterator it=bufs.begin();
+            it!=bufs.end();++it)
+    {
+        moved+=rxRing->pop(asio::buffer_cast<char*>(*it),
+                asio::buffer_size(*it));
+    }
+    readData.commit(moved);
+    rxPulled+=moved;
+    return moved;
+}
+
+bool CUart::waitRing(const boost::system_time& deadline)
+{
+    boost::mutex::scoped_lock lock(rxMutex);
+    while(rxRing->read_available()==0 && rxRunning && !rxError)
+    {
+        if(!rxCond.timed_wait(lock,deadline)) return false;
+    }
+    return true;
+}
+
+boost::system_time CUart::readDeadline() const
+{
+    //No timeout is translated into a very long timeout, as in read()
+    if(timeout != posix_time::milliseconds(0))
+        return boost::get_system_time()+timeout;
+    return boost::get_system_time()+posix_time::hours(100000);
+}
+
+CByteStream::Clock::time_point CUart::receiveTime(size_t after)
+{
+    //Data left in readData from before the reader started
+    if(after>=rxPulled) return rxTime;
+    size_t end=rxPulled-after;
+    RxStamp s;
+    while(rxStampCur.end<end && rxStamps->pop(s)) rxStampCur=s;
+    return rxStampCur.time;
+}
+
+int CUart::readFromRing(char *data, size_t size)
+{
+    boost::system_time deadline=readDeadline();
+    size_t copied=0;
+    if(readData.size()>0)//If there is some data from a previous read
+    {
+        copied=readData.sgetn(data,size);
+        rxScanPos=0;
+    }
+    int rc=resultSuccess;
+    while(copied<size)
+    {
+        size_t got=rxRing->pop(data+copied,size-copied);
+        rxPulled+=got;
+        copied+=got;
+        if(copied==size) break;
+        if(rxError) rc=resultError;
+        else if(!rxRunning && rxRing->read_available()==0) rc=resultError;
+        else if(!waitRing(deadline) && rxRing->read_available()==0)
+            rc=resultTimeoutExpired;
+        if(rc!=resultSuccess)
+        {
+            //Keep the bytes taken so far for the next read
+            readData.sputn(data,copied);
+            break;
+        }
+    }
+    return rc;
+}
+
+int CUart::readLineFromRing(const std::string& delim, size_t& lineSize,
+        const boost::system_time& deadline)
+{
     for(;;)
     {
-        io.run_one();
-        switch(result)
+        pullRing();
+        if(readData.size()>=delim.size() && !delim.empty())
         {
-            case resultSuccess:
-                {
-                    timer.cancel();
-                    bytesTransferred-=delim.size();//Don't count delim
-                    istream is(&readData);
-#if 0
-                    is.read(&out[0],bytesTransferred);//Fill values
-#else
-                    // Read to string and remove non-printables from result string
-                    for(std::size_t idx = 0; idx < bytesTransferred; idx++)
-                    {
-                        char c = static_cast<char>(is.get());
-                        if( ! is_binary(c))
-                        {
-                            out += c;
-                        }
-                    }
-#endif
-                    is.ignore(delim.size());//Remove delimiter from stream
-                    return result;
-                }
-            case resultTimeoutExpired:
-                port.cancel();
-                //throw(timeout_exception("Timeout expired"));
-                return result;
-            case resultError:
-                timer.cancel();
-                port.cancel();
-                //throw(boost::system::system_error(boost::system::error_code(), "Error while reading"));
-                return result;
-            default:
-                //if resultInProgress remain in the loop
-                break;
+            const char *p=lineData();
+            const char *pos=findDelim(p+rxScanPos,readData.size()-rxScanPos,
+                    delim);
+            if(pos)
+            {
+                lineSize=(pos-p)+delim.size();
+                return resultSuccess;
+            }
+            // Next search restarts where a partial delimiter may begin
+            rxScanPos=readData.size()-delim.size()+1;
         }
+        if(rxError) return resultError;
+        if(!rxRunning && rxRing->read_available()==0) return resultError;
+        if(!waitRing(deadline) && rxRing->read_available()==0)
+            return resultTimeoutExpired;
     }
 }
 
-CUart::~CUart() {}
+CUart::~CUart()
+{
+    stopReader();
+}
 
 void CUart::performReadSetup(const ReadSetupParameters& param)
 {
+    readPending=true;
+    setupLevel=readData.size();
     if(param.fixedSize)
     {
         asio::async_read(port,asio::buffer(param.data,param.size),boost::bind(
@@ -229,16 +875,23 @@ void CUart::performReadSetup(const ReadSetupParameters& param)
 
 void CUart::timeoutExpired(const boost::system::error_code& error)
 {
+     timerPending=false;
      if(!error && result == resultInProgress) result = resultTimeoutExpired;
 }
 
 void CUart::readCompleted(const boost::system::error_code& error,
         const size_t bytesTransferred)
 {
+    readPending=false;
+    this->bytesTransferred=bytesTransferred;
+    if(setupParameters.fixedSize ? bytesTransferred>0 : readData.size()>setupLevel)
+        rxTime=Clock::now();
+    //A read canceled on timeout keeps the timeout result
+    if(result!=resultInProgress) return;
+
     if(!error)
     {
         result=resultSuccess;
-        this->bytesTransferred=bytesTransferred;
         return;
     }
 
@@ -254,3 +907,40 @@ void CUart::readCompleted(const boost::system::error_code& error,
 
     result=resultError;
 }
+
+CUartService::CUartService(size_t threads): io()
+{
+    if(threads>0) start(threads);
+}
+
+CUartService::~CUartService()
+{
+    stop();
+}
+
+asio::io_service& CUartService::getIoService()
+{
+    return io;
+}
+
+void CUartService::start(size_t threads)
+{
+    if(!work) work.reset(new asio::io_service::work(io));
+    for(size_t i=0;i<threads;i++)
+    {
+        pool.create_thread(boost::bind(&asio::io_service::run,&io));
+    }
+}
+
+void CUartService::stop()
+{
+    work.reset();
+    io.stop();
+    pool.join_all();
+    io.reset();
+}
+
+size_t CUartService::size() const
+{
+    return pool.size();
+}
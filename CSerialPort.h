@@ -4,6 +4,9 @@
 
 #include <stdexcept>
 #include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/array.hpp>
 
 // === fix for Cygwin ===
 /// 1st issue
@@ -29,6 +32,13 @@ inline speed_t cfgetospeed(const struct termios *tp)
 #endif // #ifdef __CYGWIN__
 
 #include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "CByteStream.h"
+#include "CUartStats.h"
 
 /**
  * Thrown if timeout occurs
@@ -43,11 +53,30 @@ public:
 /**
  * Serial port class, with timeout on read operations.
  */
-class CUart: private boost::noncopyable
+class CUart: public CByteStream, private boost::noncopyable
 {
 public:
+    /**
+     * Completion handler of asyncWrite() and asyncFlush()
+     * \param result status of type ReadResult (resultSuccess or resultError)
+     * \param size number of bytes written
+     */
+    typedef boost::function<void (int result, size_t size)> WriteHandler;
+
     CUart();
 
+    /**
+     * Serial port running on an external io_service.
+     * The caller runs the io_service, so one thread may service several
+     * ports and timers (see CUartService). Handlers of one port never run
+     * concurrently, even if the io_service is run by a thread pool.
+     * Use the async*() functions on such a port: the blocking reads pump
+     * the io_service themselves, and the background reader needs an
+     * io_service of its own.
+     * \param ios io_service to run asynchronous operations on
+     */
+    explicit CUart(boost::asio::io_service& ios);
+
     /**
      * Opens a serial device. By default timeout is disabled.
      * \param devname serial device name, example "/dev/ttyS0" or "COM1"
@@ -126,19 +155,37 @@ public:
     /**
      * \return true if serial device is open
      */
-    bool isOpen() const;
+    virtual bool isOpen() const;
+
+    /**
+     * Opt-in low-latency profile, applied by open() and immediately if
+     * the device is open:
+     * - termios VMIN=1, VTIME=0: a read returns as soon as a byte arrives
+     * - ASYNC_LOW_LATENCY serial flag (Linux), which also drops the 16 ms
+     *   latency timer of FTDI and similar USB-serial adapters to 1 ms
+     * Settings not supported by the device are skipped. The settings the
+     * profile changes are saved when it is applied and restored when it
+     * is switched off.
+     * \param on true to enable, false to restore the saved settings
+     */
+    void setLowLatency(bool on);
+
+    /**
+     * \return true if the ASYNC_LOW_LATENCY flag is set on the device
+     */
+    bool isLowLatency() const;
 
     /**
      * Close the serial device
      * \throws boost::system::system_error if any error
      */
-    void close();
+    virtual void close();
 
     /**
      * Set the timeout on read/write operations.
      * To disable the timeout, call setTimeout(boost::posix_time::seconds(0));
      */
-    void setTimeout(const boost::posix_time::time_duration& t);
+    virtual void setTimeout(const boost::posix_time::time_duration& t);
 
     /**
      * Write data
@@ -146,7 +193,7 @@ public:
      * \param size array size
      * \throws boost::system::system_error if any error
      */
-    void write(const char *data, size_t size);
+    virtual void write(const char *data, size_t size);
 
      /**
      * Write data
@@ -161,17 +208,87 @@ public:
     * \param s string to send
     * \throws boost::system::system_error if any error
     */
-    void writeString(const std::string& s);
+    virtual void writeString(const std::string& s);
 
     /**
-     * Read some data, blocking
+    * Write a string and a line terminator with one gather write
+    * \param s string to send
+    * \param eol line terminator
+    * \throws boost::system::system_error if any error
+    */
+    virtual void writeLine(const std::string& s, const std::string& eol);
+
+    /**
+    * Write a sequence of buffers with one gather write (writev), without
+    * concatenating them first.
+    * \param buffers sequence of boost::asio::const_buffer, e.g. boost::array
+    * \throws boost::system::system_error if any error
+    */
+    template <class ConstBufferSequence>
+    void writeGather(const ConstBufferSequence& buffers)
+    {
+        CUartCounters::Clock::time_point start=CUartCounters::Clock::now();
+        try {
+            stats.writeDone(start,true,boost::asio::write(port,buffers));
+        } catch(...) {
+            stats.writeDone(start,false,0);
+            throw;
+        }
+    }
+
+    /**
+    * Queue data for writing. Data is copied to a fragment of the outbound
+    * queue, whose storage is reused, so no allocation in steady state.
+    * Queued fragments are sent together by flush() or asyncFlush().
+    * \param data array of char to be queued
+    * \param size array size
+    * \return queue depth in bytes after queuing, for backpressure
+    */
+    size_t queueWrite(const char *data, size_t size);
+
+    /**
+    * Queue a string for writing, see queueWrite()
+    * \param s string to queue
+    * \return queue depth in bytes after queuing
+    */
+    size_t queueWriteString(const std::string& s);
+
+    /**
+    * Write all queued fragments with one gather write, blocking.
+    * Must not be called while asyncFlush() is in progress.
+    * \throws boost::system::system_error if any error
+    */
+    void flush();
+
+    /**
+    * Write all queued fragments with one gather write, non-blocking.
+    * Fragments queued while the write is in progress are written by a
+    * following gather write. The handler is called from the io_service when
+    * the queue is empty or on error, never from inside asyncFlush(). A call
+    * during a flush in progress adds its handler, all handlers are called,
+    * in call order, when that flush completes.
+    * \param handler completion handler, may be empty
+    */
+    void asyncFlush(const WriteHandler& handler=WriteHandler());
+
+    /**
+    * \return bytes queued and not yet written, including a write
+    * in progress
+    */
+    size_t getQueueDepth() const;
+
+    /**
+     * Read exactly size bytes, blocking.
+     * Data buffered by previous line reads is used first, the remainder is
+     * read directly into data. On timeout or error the bytes received so
+     * far are kept for the next read.
      * \param data array of char to be read through the serial device
      * \param size array size
      * \return status of type ReadResult
      * \throws NO boost::system::system_error if any error
      * \throws NO timeout_exception in case of timeout
      */
-    int read(char *data, size_t size);
+    virtual int read(char *data, size_t size);
 
     /**
      * Read some data, blocking
@@ -186,13 +303,14 @@ public:
      * Read a string, blocking
      * Can only be used if the user is sure that the serial device will not
      * send binary data. For binary data read, use read()
-     * The returned string is empty if no data has arrived
+     * Reads out.capacity() bytes. The string is not zero-filled or
+     * reallocated when its size already equals its capacity.
      * \param [out] a string with the received data.
      * \return status of type ReadResult
      * \throws NO boost::system::system_error if any error
      * \throws NO timeout_exception in case of timeout
      */
-    int readString(std::string &out);
+    virtual int readString(std::string &out);
 
     /**
      * Read a line, blocking
@@ -206,19 +324,141 @@ public:
      * \throws NO boost::system::system_error if any error
      * \throws NO timeout_exception in case of timeout
      */
-    int readStringUntil(std::string &out, const std::string& delim="\n");
+    virtual int readStringUntil(std::string &out, const std::string& delim="\n");
 
-    ~CUart();
+    /**
+     * Read a line to caller-owned buffer, blocking
+     * Same as readStringUntil(), but without heap allocation: the line is
+     * scanned in bulk in the receive buffer and copied to data. A line
+     * longer than size is truncated, the rest of it is discarded.
+     * \param [out] data buffer for the received line, not null-terminated
+     * \param [in] size buffer size
+     * \param [out] len line length in the buffer, 0 if nothing has arrived
+     * \param [in] delimiter line delimiter, default="\n"
+     * \return status of type ReadResult
+     */
+    int readLine(char *data, size_t size, size_t &len,
+            const std::string& delim="\n");
+
+    /**
+     * Read the next line accepted by a filter, blocking
+     * Lines are filtered in the receive buffer, rejected lines are consumed
+     * from it without being copied.
+     * \param [out] out string the line is appended to, without delimiter
+     * \param [in] delim line delimiter
+     * \param [in] filter line filter
+     * \param [out] skipped incremented for every rejected line
+     * \return status of type ReadResult
+     */
+    virtual int readFilteredLine(std::string &out, const std::string& delim,
+            const LineFilter& filter, size_t &skipped);
+
+    /**
+     * Arrival time of the data returned by the last successful read.
+     * With the background reader running, each chunk the reader gets from
+     * the device is stamped, and a line gets the time of the chunk holding
+     * its delimiter, however long it then waited in the ring. Also valid
+     * in the handler of asyncReadStringUntil().
+     * \return receive time, Clock::time_point() before the first read
+     */
+    virtual Clock::time_point getReceiveTime() const;
+
+    /**
+     * Completion handler of asyncReadStringUntil()
+     * \param result status of type ReadResult
+     * \param line received line, delimiter and non-printables removed.
+     * Valid only during the call
+     */
+    typedef boost::function<void (int result, const std::string& line)>
+            ReadHandler;
 
     /**
-     * Possible outcome of a read. Set by callbacks, read from main code
+     * Read a line, non-blocking.
+     * Returns immediately, handler is called from the io_service when the
+     * line has arrived, on error, or when the timeout expired.
+     * Only one read may be outstanding at a time.
+     * \param delim line delimiter
+     * \param handler completion handler
      */
-    enum ReadResult
+    void asyncReadStringUntil(const std::string& delim,
+            const ReadHandler& handler);
+
+    /**
+     * Write data, non-blocking.
+     * The data must stay valid until the handler is called.
+     * \param data array of char to be sent through the serial device
+     * \param size array size
+     * \param handler completion handler, may be empty
+     */
+    void asyncWrite(const char *data, size_t size,
+            const WriteHandler& handler=WriteHandler());
+
+    /**
+     * Write a string, non-blocking. The string is copied.
+     * \param s string to send
+     * \param handler completion handler, may be empty
+     */
+    void asyncWriteString(const std::string& s,
+            const WriteHandler& handler=WriteHandler());
+
+    /**
+     * Cancel outstanding asynchronous operations.
+     * Their handlers are called with resultError. A read timeout cancels
+     * the read only, writes in progress continue.
+     */
+    void cancel();
+
+    /**
+     * \return io_service the port runs on
+     */
+    boost::asio::io_service& getIoService();
+
+    /**
+     * Snapshot of I/O counters and latency histograms.
+     * Counters are always on and lock-free, so this may be called from any
+     * thread at any time, e.g. to export them periodically.
+     * \param [out] out counters since construction or resetStats()
+     */
+    void getStats(CUartStats& out) const;
+
+    /**
+     * Reset I/O counters and latency histograms
+     */
+    void resetStats();
+
+    /**
+     * Start background reader.
+     * A dedicated thread runs the io_service and continuously drains the
+     * serial device into a bounded receive ring, so data is not lost
+     * between reads. While the reader runs, read() and readStringUntil()
+     * consume from the ring (lock-free) and wait on it with the timeout.
+     * When the ring is full the reader stops draining the device until
+     * the consumer catches up.
+     * \param ring_size receive ring capacity, bytes
+     * \throws boost::system::system_error if device is not open, or if
+     * the port runs on an external io_service
+     */
+    void startReader(size_t ring_size = DEFAULT_RING_SIZE);
+
+    /**
+     * Stop background reader and join its thread.
+     * Data left in the ring stays available for the next read.
+     */
+    void stopReader();
+
+    /**
+     * \return true if background reader is running
+     */
+    bool isReaderRunning() const;
+
+    ~CUart();
+
+    /// Receive ring defaults
+    enum RingSize
     {
-        resultInProgress,
-        resultSuccess,
-        resultError,
-        resultTimeoutExpired
+        DEFAULT_RING_SIZE = 64 * 1024, // bytes
+        READER_CHUNK_SIZE = 512,       // bytes per read from device
+        READER_STAMPS = 1024           // chunk timestamps kept in flight
     };
     
 private:
@@ -246,6 +486,21 @@ private:
         size_t size; ///< Array size (valid if fixedSize=true)
     };
 
+    /**
+     * Read some data, blocking, pumping io (no background reader)
+     */
+    int readDirect(char *data, size_t size);
+
+    /**
+     * Perform a blocking read operation, pumping io until it completes or
+     * the deadline passes. The timer is armed only if no data is buffered,
+     * and handlers of canceled operations are run before returning.
+     * \param deadline absolute deadline, see readDeadline()
+     * \return status of type ReadResult, bytesTransferred is set
+     */
+    int performRead(const ReadSetupParameters& param,
+            const boost::system_time& deadline);
+
     /**
      * This member function sets up a read operation, both reading a specified
      * number of characters and reading until a delimiter string.
@@ -267,25 +522,265 @@ private:
             const size_t bytesTransferred);
 
     /**
-    * Check if binary data in a character
-    */
-    bool is_binary(char c)
+     * Callback called when asynchronous line read completes
+     */
+    void asyncReadCompleted(const boost::system::error_code& error,
+            const size_t bytesTransferred);
+
+    /**
+     * Callback called when asynchronous read timeout expired or canceled
+     */
+    void asyncTimeoutExpired(const boost::system::error_code& error);
+
+    /**
+     * Cancel asynchronous operations, runs in the strand
+     */
+    void doCancel();
+
+    /**
+     * Move pending fragments to in-flight and build the gather list
+     * \return false if nothing is pending
+     */
+    bool prepareFlush();
+
+    /**
+     * Start asynchronous gather write of in-flight fragments
+     */
+    void asyncFlushSetup();
+
+    /**
+     * Callback called when asynchronous gather write completes
+     */
+    void asyncFlushCompleted(const boost::system::error_code& error,
+            const size_t bytesTransferred);
+
+    /**
+     * End the asynchronous flush, call the handlers of all asyncFlush() calls
+     */
+    void asyncFlushDone(int result, size_t bytesTransferred);
+
+    /**
+     * Start asynchronous gather write of the unwritten in-flight fragments
+     */
+    void asyncFlushWrite();
+
+    /**
+     * Outstanding asyncWrite() or asyncWriteString()
+     */
+    struct AsyncWrite
     {
-        if(c >= ' ' || c == '\n' || c == '\r')
-        {
-            return false;
-        }
-        return true;
+        WriteHandler handler;
+        std::string keep; ///< Copy of the string of asyncWriteString()
+        const char *data;
+        size_t size;
+        size_t done; ///< Bytes written so far
+        CUartCounters::Clock::time_point start;
+        unsigned cancels; ///< cancelCount at the start
     };
 
-    boost::asio::io_service io; ///< Io service object
+    /**
+     * Start asynchronous write of the unwritten part of a write
+     */
+    void asyncWriteSetup(boost::shared_ptr<AsyncWrite> op);
+
+    /**
+     * Callback called when asynchronous write completes
+     */
+    void asyncWriteCompleted(boost::shared_ptr<AsyncWrite> op,
+            const boost::system::error_code& error,
+            const size_t bytesTransferred);
+
+    /**
+     * A port operation aborted without cancel(): the port was canceled to
+     * end a timed out read, a write continues
+     * \param cancels cancelCount at the start of the write
+     */
+    bool abortedByRead(const boost::system::error_code& error,
+            unsigned cancels) const;
+
+    /**
+     * Background reader: arm next read of the device
+     */
+    void readerSetup();
+
+    /**
+     * Background reader: callback called when a chunk arrived from device.
+     * Pushes it to the receive ring and re-arms the read.
+     */
+    void readerCompleted(const boost::system::error_code& error,
+            const size_t bytesTransferred);
+
+    /**
+     * Background reader: push pending chunk to the receive ring.
+     * If the ring is full, retries later instead of dropping data.
+     */
+    void readerPush(const boost::system::error_code& error);
+
+    /**
+     * Move everything the background reader has received to readData
+     * \return number of bytes moved
+     */
+    size_t pullRing();
+
+    /**
+     * Wait until background reader delivers more data or deadline expires
+     * \return false if deadline expired
+     */
+    bool waitRing(const boost::system_time& deadline);
+
+    /**
+     * Compute absolute deadline of a read from the timeout
+     */
+    boost::system_time readDeadline() const;
+
+    /**
+     * Arrival time of received data, by position in readData
+     * \param after bytes in readData after the data
+     */
+    Clock::time_point receiveTime(size_t after);
+
+    /**
+     * Read some data from receive ring, blocking (background reader mode)
+     */
+    int readFromRing(char *data, size_t size);
+
+    /**
+     * Read a line from receive ring, blocking (background reader mode)
+     * \param [out] number of bytes up to and including the delimiter
+     */
+    int readLineFromRing(const std::string& delim, size_t& lineSize,
+            const boost::system_time& deadline);
+
+    /**
+     * Apply the low-latency profile to the open device, or restore the
+     * settings it replaced
+     */
+    void applyLowLatency();
+
+    /**
+     * Wait until a complete line is in readData
+     * \param [out] number of bytes up to and including the delimiter
+     * \param deadline absolute deadline, see readDeadline()
+     */
+    int waitLine(const std::string& delim, size_t &lineSize,
+            const boost::system_time& deadline);
+
+    /**
+     * \return start of the received data in readData
+     */
+    const char *lineData() const;
+
+    boost::scoped_ptr<boost::asio::io_service> ownIo; ///< Io service, if not external
+    boost::asio::io_service& io; ///< Io service object
     boost::asio::serial_port port; ///< Serial port object
+    boost::asio::io_service::strand strand; ///< Serializes async handlers if io runs on a thread pool
     boost::asio::deadline_timer timer; ///< Timer for timeout
     boost::posix_time::time_duration timeout; ///< Read/write timeout
     boost::asio::streambuf readData; ///< Holds eventual read but not consumed
     enum ReadResult result;  ///< Used by read with timeout
     size_t bytesTransferred; ///< Used by async read callback
     ReadSetupParameters setupParameters; ///< Global because used in the OSX fix
+    size_t setupLevel; ///< Bytes in readData when the blocking read was set up
+    size_t asyncLevel; ///< Bytes in readData when the asynchronous read was set up
+    Clock::time_point rxTime; ///< Arrival of the last bytes read by io
+    Clock::time_point readTime; ///< Arrival of the data of the last successful read
+    bool lowLatency; ///< Low-latency profile requested
+    bool lowLatencyApplied; ///< Profile applied to the open device, settings below saved
+    unsigned char savedVmin; ///< termios VMIN before the profile
+    unsigned char savedVtime; ///< termios VTIME before the profile
+    int savedLowLatencyFlag; ///< ASYNC_LOW_LATENCY before the profile, -1 - no serial_struct
+
+    boost::scoped_ptr<boost::lockfree::spsc_queue<char> > rxRing; ///< Receive ring, filled by background reader
+    boost::thread rxThread; ///< Background reader thread, runs io
+    boost::asio::deadline_timer rxRetryTimer; ///< Reader retry timer, used when ring is full
+    boost::mutex rxMutex; ///< Guards only sleeping on rxCond, not the data
+    boost::condition_variable rxCond; ///< Signalled when reader pushed data
+    boost::atomic<bool> rxRunning; ///< Background reader is running
+    boost::atomic<bool> rxError; ///< Background reader stopped on error
+    char rxChunk[READER_CHUNK_SIZE]; ///< Chunk read from device, not yet in ring
+    size_t rxChunkSize; ///< Bytes in rxChunk
+    size_t rxChunkPos; ///< Bytes of rxChunk already pushed to ring
+    size_t rxScanPos; ///< Bytes of readData already searched for delimiter
+
+    /// Arrival time of a chunk pushed by the background reader
+    struct RxStamp
+    {
+        size_t end; ///< Stream offset after the chunk, bytes since startReader()
+        Clock::time_point time; ///< Arrival of the chunk
+    };
+    boost::scoped_ptr<boost::lockfree::spsc_queue<RxStamp> > rxStamps; ///< Chunk times, pushed ahead of their data
+    Clock::time_point rxChunkTime; ///< Arrival of rxChunk
+    size_t rxPushed; ///< Bytes pushed to the ring (reader thread)
+    size_t rxPulled; ///< Bytes popped from the ring (consumer)
+    RxStamp rxStampCur; ///< Stamp of the chunk the consumer is reading
+
+    CUartCounters stats; ///< I/O counters and latency histograms
+    CUartCounters::Clock::time_point asyncStart; ///< Start of outstanding asynchronous read
+    CUartCounters::Clock::time_point txStart; ///< Start of asynchronous flush write
+    boost::asio::deadline_timer asyncTimer; ///< Timer for asynchronous read timeout
+    std::string asyncDelim; ///< Delimiter of outstanding asynchronous read
+    std::string asyncLine; ///< Line passed to asynchronous read handler
+    ReadHandler asyncHandler; ///< Handler of outstanding asynchronous read
+    bool asyncTimedOut; ///< Outstanding asynchronous read timed out
+    bool readPending; ///< Blocking read operation not completed yet
+    bool timerPending; ///< Blocking read timer handler not run yet
+
+    mutable boost::mutex txMutex; ///< Guards the outbound queue
+    std::vector<std::string> txPending; ///< Queued fragments, storage reused
+    size_t txPendingCount; ///< Fragments in txPending in use
+    size_t txPendingBytes; ///< Bytes in queued fragments
+    std::vector<std::string> txInFlight; ///< Fragments being written
+    size_t txInFlightCount; ///< Fragments in txInFlight in use
+    size_t txInFlightBytes; ///< Bytes being written
+    std::vector<boost::asio::const_buffer> txBuffers; ///< Gather list of in-flight fragments
+    bool txBusy; ///< Asynchronous flush in progress
+    std::vector<WriteHandler> txHandlers; ///< Handlers of asynchronous flush
+    size_t txWritten; ///< Bytes of the in-flight fragments written so far
+    unsigned txCancels; ///< cancelCount at the start of the flush write
+    boost::atomic<unsigned> cancelCount; ///< cancel() calls, a read timeout cancels the port too
+};
+
+/**
+ * io_service shared by many serial ports, optionally run by a thread pool.
+ * Construct CUart objects with getIoService() to have all of them served
+ * by a single reactor.
+ */
+class CUartService: private boost::noncopyable
+{
+public:
+    /**
+     * \param threads number of pool threads running the io_service.
+     * With 0 threads the caller runs getIoService() itself.
+     */
+    explicit CUartService(size_t threads = 0);
+
+    ~CUartService();
+
+    /**
+     * \return shared io_service
+     */
+    boost::asio::io_service& getIoService();
+
+    /**
+     * Add threads running the io_service
+     * \param threads number of threads to add
+     */
+    void start(size_t threads);
+
+    /**
+     * Stop the io_service and join pool threads
+     */
+    void stop();
+
+    /**
+     * \return number of pool threads
+     */
+    size_t size() const;
+
+private:
+    boost::asio::io_service io; ///< Shared io service
+    boost::scoped_ptr<boost::asio::io_service::work> work; ///< Keeps pool threads running while idle
+    boost::thread_group pool; ///< Threads running io
 };
 
 #endif // __CSERIALPORT_H__
@@ -0,0 +1,72 @@
+#ifndef __CSOCKETSTREAM_H__
+#define __CSOCKETSTREAM_H__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "CFdStream.h"
+
+// --------------------------------------------
+/// Byte stream over a connected TCP or Unix domain socket, e.g. a relay
+/// of the device output (socat, gpsd raw mode) or a replay server.
+/// The connection is made with asio, data is then read through the
+/// socket descriptor as in CFdStream.
+class CSocketStream : public CFdStream
+{
+public:
+    CSocketStream() {};
+
+    virtual ~CSocketStream() { close(); };
+
+    /**
+    * Connect to a socket
+    * \param address "host:port" for TCP, path of a Unix domain socket otherwise
+    * \throws boost::system::system_error if connection fails
+    */
+    void open(const std::string & address)
+    {
+        close();
+        size_t colon = address.rfind(':');
+        if(address.find('/') == std::string::npos && colon != std::string::npos)
+        {
+            using boost::asio::ip::tcp;
+            tcp::resolver resolver(io);
+            tcp::resolver::query query(address.substr(0, colon), address.substr(colon + 1));
+            tcpSocket.reset(new tcp::socket(io));
+            boost::asio::connect(*tcpSocket, resolver.resolve(query));
+            tcpSocket->set_option(tcp::no_delay(true));
+            attach(tcpSocket->native_handle(), false);
+        }
+        else
+        {
+            using boost::asio::local::stream_protocol;
+            localSocket.reset(new stream_protocol::socket(io));
+            localSocket->connect(stream_protocol::endpoint(address));
+            attach(localSocket->native_handle(), false);
+        }
+    };
+
+    virtual void close()
+    {
+        CFdStream::close();
+        boost::system::error_code ec;
+        if(tcpSocket)
+        {
+            tcpSocket->close(ec);
+            tcpSocket.reset();
+        }
+        if(localSocket)
+        {
+            localSocket->close(ec);
+            localSocket.reset();
+        }
+    };
+
+private:
+    boost::asio::io_service io;
+    boost::scoped_ptr<boost::asio::ip::tcp::socket> tcpSocket;
+    boost::scoped_ptr<boost::asio::local::stream_protocol::socket> localSocket;
+};
+
+#endif // __CSOCKETSTREAM_H__
@@ -0,0 +1,214 @@
+#ifndef __CUARTSTATS_H__
+#define __CUARTSTATS_H__
+
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+
+/**
+ * Lock-free latency histogram.
+ * Bucket 0 counts durations below 1 us, bucket i durations in
+ * [2^(i-1), 2^i) us, the last bucket everything longer. Safe to update
+ * from several threads and to snapshot concurrently.
+ */
+class CLatencyHistogram
+{
+public:
+    enum { BUCKETS = 24 }; ///< Last bucket starts at 2^22 us, ~4.2 s
+
+    /**
+     * Plain copy of the histogram
+     */
+    struct Snapshot
+    {
+        boost::uint64_t count; ///< Number of samples
+        boost::uint64_t sumUs; ///< Sum of samples, us
+        boost::uint64_t maxUs; ///< Longest sample, us
+        boost::uint64_t buckets[BUCKETS]; ///< Samples per bucket
+
+        /**
+         * \return upper bound of bucket i, us (lower bound of bucket i+1)
+         */
+        static boost::uint64_t bucketLimitUs(int i) { return boost::uint64_t(1) << i; }
+
+        /**
+         * \return upper bound of the bucket holding the given percentile, us
+         */
+        boost::uint64_t percentileUs(double pct) const
+        {
+            boost::uint64_t want = static_cast<boost::uint64_t>(count * pct / 100.0);
+            boost::uint64_t seen = 0;
+            for(int i = 0; i < BUCKETS; i++)
+            {
+                seen += buckets[i];
+                if(seen > want) return bucketLimitUs(i);
+            }
+            return maxUs;
+        }
+    };
+
+    CLatencyHistogram() { reset(); }
+
+    /**
+     * Add a sample
+     * \param us duration, us
+     */
+    void add(boost::uint64_t us)
+    {
+        int i = 0;
+        while(i < BUCKETS - 1 && us >= Snapshot::bucketLimitUs(i)) i++;
+        buckets[i].fetch_add(1, boost::memory_order_relaxed);
+        count.fetch_add(1, boost::memory_order_relaxed);
+        sumUs.fetch_add(us, boost::memory_order_relaxed);
+        boost::uint64_t m = maxUs.load(boost::memory_order_relaxed);
+        while(us > m && !maxUs.compare_exchange_weak(m, us, boost::memory_order_relaxed)) {}
+    }
+
+    /**
+     * Copy current values. Values are read one by one, so a snapshot
+     * taken during updates may be off by the samples being added.
+     */
+    void snapshot(Snapshot& out) const
+    {
+        out.count = count.load(boost::memory_order_relaxed);
+        out.sumUs = sumUs.load(boost::memory_order_relaxed);
+        out.maxUs = maxUs.load(boost::memory_order_relaxed);
+        for(int i = 0; i < BUCKETS; i++)
+            out.buckets[i] = buckets[i].load(boost::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        count = 0;
+        sumUs = 0;
+        maxUs = 0;
+        for(int i = 0; i < BUCKETS; i++) buckets[i] = 0;
+    }
+
+private:
+    boost::atomic<boost::uint64_t> count;
+    boost::atomic<boost::uint64_t> sumUs;
+    boost::atomic<boost::uint64_t> maxUs;
+    boost::atomic<boost::uint64_t> buckets[BUCKETS];
+};
+
+/**
+ * Snapshot of CUart I/O counters, see CUart::getStats()
+ */
+struct CUartStats
+{
+    boost::uint64_t bytesIn; ///< Bytes delivered to readers, delimiters included
+    boost::uint64_t bytesOut; ///< Bytes written to the device
+    boost::uint64_t reads; ///< Completed reads
+    boost::uint64_t lines; ///< Completed line reads
+    boost::uint64_t writes; ///< Completed writes
+    boost::uint64_t timeouts; ///< Reads ended by timeout
+    boost::uint64_t errors; ///< Reads and writes ended by error
+    boost::uint64_t rxHighWater; ///< Most bytes held in receive buffer and ring
+    CLatencyHistogram::Snapshot readLatency; ///< Read call to completion
+    CLatencyHistogram::Snapshot writeLatency; ///< Write duration
+};
+
+/**
+ * Always-on CUart I/O counters, updated with relaxed atomics
+ */
+class CUartCounters
+{
+public:
+    typedef boost::chrono::steady_clock Clock;
+
+    CUartCounters() { reset(); }
+
+    /**
+     * Account a finished read
+     * \param start time the read was requested
+     * \param ok true if completed, false on error
+     * \param timedOut true if ended by timeout
+     * \param size bytes delivered
+     * \param lines lines delivered
+     */
+    void readDone(const Clock::time_point& start, bool ok, bool timedOut,
+            size_t size, size_t lines)
+    {
+        if(ok)
+        {
+            reads.fetch_add(1, boost::memory_order_relaxed);
+            bytesIn.fetch_add(size, boost::memory_order_relaxed);
+            if(lines) this->lines.fetch_add(lines, boost::memory_order_relaxed);
+        }
+        else if(timedOut) timeouts.fetch_add(1, boost::memory_order_relaxed);
+        else errors.fetch_add(1, boost::memory_order_relaxed);
+        readLatency.add(elapsedUs(start));
+    }
+
+    /**
+     * Account a finished write
+     */
+    void writeDone(const Clock::time_point& start, bool ok, size_t size)
+    {
+        if(ok)
+        {
+            writes.fetch_add(1, boost::memory_order_relaxed);
+            bytesOut.fetch_add(size, boost::memory_order_relaxed);
+        }
+        else errors.fetch_add(1, boost::memory_order_relaxed);
+        writeLatency.add(elapsedUs(start));
+    }
+
+    /**
+     * Account receive buffer fill level
+     */
+    void rxLevel(size_t size)
+    {
+        boost::uint64_t m = rxHighWater.load(boost::memory_order_relaxed);
+        while(size > m && !rxHighWater.compare_exchange_weak(m, size, boost::memory_order_relaxed)) {}
+    }
+
+    void snapshot(CUartStats& out) const
+    {
+        out.bytesIn = bytesIn.load(boost::memory_order_relaxed);
+        out.bytesOut = bytesOut.load(boost::memory_order_relaxed);
+        out.reads = reads.load(boost::memory_order_relaxed);
+        out.lines = lines.load(boost::memory_order_relaxed);
+        out.writes = writes.load(boost::memory_order_relaxed);
+        out.timeouts = timeouts.load(boost::memory_order_relaxed);
+        out.errors = errors.load(boost::memory_order_relaxed);
+        out.rxHighWater = rxHighWater.load(boost::memory_order_relaxed);
+        readLatency.snapshot(out.readLatency);
+        writeLatency.snapshot(out.writeLatency);
+    }
+
+    void reset()
+    {
+        bytesIn = 0;
+        bytesOut = 0;
+        reads = 0;
+        lines = 0;
+        writes = 0;
+        timeouts = 0;
+        errors = 0;
+        rxHighWater = 0;
+        readLatency.reset();
+        writeLatency.reset();
+    }
+
+private:
+    static boost::uint64_t elapsedUs(const Clock::time_point& start)
+    {
+        return boost::chrono::duration_cast<boost::chrono::microseconds>(
+                Clock::now() - start).count();
+    }
+
+    boost::atomic<boost::uint64_t> bytesIn;
+    boost::atomic<boost::uint64_t> bytesOut;
+    boost::atomic<boost::uint64_t> reads;
+    boost::atomic<boost::uint64_t> lines;
+    boost::atomic<boost::uint64_t> writes;
+    boost::atomic<boost::uint64_t> timeouts;
+    boost::atomic<boost::uint64_t> errors;
+    boost::atomic<boost::uint64_t> rxHighWater;
+    CLatencyHistogram readLatency;
+    CLatencyHistogram writeLatency;
+};
+
+#endif // __CUARTSTATS_H__
@@ -0,0 +1,223 @@
+#ifndef __CUBX_H__
+#define __CUBX_H__
+
+#include <string>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+#include "CGpsFix.h"
+
+// --------------------------------------------
+/// u-blox UBX binary protocol.
+/// Frame: sync 0xB5 0x62, class, id, little-endian 16-bit payload length,
+/// payload, 8-bit Fletcher checksum over class..payload. Builds the
+/// configuration commands used by CGps and decodes NAV-PVT to CGpsFix.
+class CUbx
+{
+public:
+    /// Frame layout
+    enum
+    {
+        SYNC_1 = 0xB5,
+        SYNC_2 = 0x62,
+        HEADER_SIZE = 6,      ///< sync, class, id, length
+        CHECKSUM_SIZE = 2,
+        MAX_PAYLOAD = 1024    ///< longer frames are taken for noise
+    };
+
+    /// Message classes and ids
+    enum
+    {
+        CLASS_NAV = 0x01,
+        CLASS_ACK = 0x05,
+        CLASS_CFG = 0x06,
+
+        NAV_PVT = 0x07,
+        ACK_NAK = 0x00,
+        ACK_ACK = 0x01,
+        CFG_PRT = 0x00,
+        CFG_MSG = 0x01,
+        CFG_RATE = 0x08,
+
+        NAV_PVT_SIZE = 92     ///< payload size of NAV-PVT
+    };
+
+    /// Port protocol masks of CFG-PRT
+    enum
+    {
+        PROTO_UBX = 0x01,
+        PROTO_NMEA = 0x02
+    };
+
+    /**
+    * 8-bit Fletcher checksum
+    * \param data class, id, length and payload
+    * \param size data size
+    * \return CK_A in the low byte, CK_B in the high byte
+    */
+    static boost::uint16_t checksum(const unsigned char *data, size_t size)
+    {
+        unsigned char a = 0, b = 0;
+        for(size_t i = 0; i < size; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        return static_cast<boost::uint16_t>(a | (b << 8));
+    };
+
+    /**
+    * Build a frame
+    * \param [out] out frame, replaces the contents
+    */
+    static void makeFrame(std::string & out, unsigned char cls, unsigned char id,
+                          const unsigned char *payload, size_t size)
+    {
+        out.resize(HEADER_SIZE + size + CHECKSUM_SIZE);
+        unsigned char *p = reinterpret_cast<unsigned char *>(&out[0]);
+        p[0] = SYNC_1;
+        p[1] = SYNC_2;
+        p[2] = cls;
+        p[3] = id;
+        put16(p + 4, static_cast<boost::uint16_t>(size));
+        if(size)
+        {
+            memcpy(p + HEADER_SIZE, payload, size);
+        }
+        put16(p + HEADER_SIZE + size, checksum(p + 2, size + 4));
+    };
+
+    /**
+    * CFG-PRT for UART1, 8N1
+    * \param baud port speed, must be the current one to keep the link
+    * \param in_proto, out_proto protocol masks, see PROTO_UBX
+    */
+    static std::string cfgPort(boost::uint32_t baud, boost::uint16_t in_proto, boost::uint16_t out_proto)
+    {
+        unsigned char payload[20] = { 0 };
+        payload[0] = 1;                      // UART1
+        put32(payload + 4, 0x000008D0);      // 8 bits, no parity, 1 stop bit
+        put32(payload + 8, baud);
+        put16(payload + 12, in_proto);
+        put16(payload + 14, out_proto);
+        std::string out;
+        makeFrame(out, CLASS_CFG, CFG_PRT, payload, sizeof(payload));
+        return out;
+    };
+
+    /**
+    * CFG-MSG, output rate of a message on the current port
+    * \param rate 1 - every navigation solution, 0 - off
+    */
+    static std::string cfgMessage(unsigned char cls, unsigned char id, unsigned char rate)
+    {
+        unsigned char payload[3] = { cls, id, rate };
+        std::string out;
+        makeFrame(out, CLASS_CFG, CFG_MSG, payload, sizeof(payload));
+        return out;
+    };
+
+    /**
+    * CFG-RATE, navigation rate, aligned to GPS time
+    * \param period_ms measurement period, msec
+    */
+    static std::string cfgRate(boost::uint16_t period_ms)
+    {
+        unsigned char payload[6] = { 0 };
+        put16(payload, period_ms);
+        put16(payload + 2, 1);               // one solution per measurement
+        put16(payload + 4, 1);               // GPS time
+        std::string out;
+        makeFrame(out, CLASS_CFG, CFG_RATE, payload, sizeof(payload));
+        return out;
+    };
+
+    /**
+    * Decode NAV-PVT to a fix, fields are updated in place as by NMEA
+    * sentences, coordinates keep their 1e-7 degree resolution
+    * \param p NAV-PVT payload
+    * \param size payload size, NAV_PVT_SIZE or more
+    * \return true if the message carried a position
+    */
+    static bool decodeNavPvt(const unsigned char *p, size_t size, CGpsFix & fix)
+    {
+        if(size < NAV_PVT_SIZE)
+        {
+            return false;
+        }
+        unsigned char valid = p[11], fix_type = p[20], flags = p[21];
+
+        if(valid & 0x01)
+        {
+            fix.year = get16(p + 4);
+            fix.month = p[6];
+            fix.day = p[7];
+            fix.flags |= CGpsFix::HAS_DATE;
+        }
+        if(valid & 0x02)
+        {
+            // nano is the fraction of the second, -1e9..1e9 ns
+            boost::int32_t ms = ((p[8] * 60 + p[9]) * 60 + p[10]) * 1000 +
+                                static_cast<boost::int32_t>(get32(p + 16)) / 1000000;
+            const boost::int32_t DAY_MS = 24 * 3600 * 1000;
+            fix.time = (ms + DAY_MS) % DAY_MS;
+            fix.flags |= CGpsFix::HAS_TIME;
+        }
+
+        fix.valid = (flags & 0x01) != 0;
+        fix.flags |= CGpsFix::HAS_STATUS;
+        fix.satellites = p[23];
+        // GGA quality: 1 - GNSS fix, 2 - differential
+        fix.quality = fix.valid ? ((flags & 0x02) ? 2 : 1) : 0;
+        fix.flags |= CGpsFix::HAS_QUALITY;
+        fix.mode = (fix_type == 2) ? 2 : (fix_type == 3 || fix_type == 4) ? 3 : 1;
+        fix.pdop = get16(p + 76) * 0.01f;
+        fix.flags |= CGpsFix::HAS_DOP;
+
+        // 1 - dead reckoning, 2 - 2D, 3 - 3D, 4 - GNSS + dead reckoning
+        bool position = fix_type >= 1 && fix_type <= 4;
+        if(position)
+        {
+            fix.longitude = static_cast<boost::int32_t>(get32(p + 24)) * 1e-7;
+            fix.latitude = static_cast<boost::int32_t>(get32(p + 28)) * 1e-7;
+            fix.latError = fix.lonError = get32(p + 40) * 0.001f;
+            fix.altError = get32(p + 44) * 0.001f;
+            fix.speed = static_cast<boost::int32_t>(get32(p + 60)) * (0.001f * 3600 / 1852);
+            fix.course = static_cast<boost::int32_t>(get32(p + 64)) * 1e-5f;
+            fix.flags |= CGpsFix::HAS_POSITION | CGpsFix::HAS_ERROR | CGpsFix::HAS_SPEED | CGpsFix::HAS_COURSE;
+            if(fix_type != 2)
+            {
+                fix.altitude = static_cast<boost::int32_t>(get32(p + 36)) * 0.001;
+                fix.flags |= CGpsFix::HAS_ALTITUDE;
+            }
+        }
+        return position;
+    };
+
+    /// \return little-endian 16-bit value
+    static boost::uint16_t get16(const unsigned char *p)
+    {
+        return static_cast<boost::uint16_t>(p[0] | (p[1] << 8));
+    };
+
+    /// \return little-endian 32-bit value
+    static boost::uint32_t get32(const unsigned char *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<boost::uint32_t>(p[3]) << 24);
+    };
+
+private:
+    static void put16(unsigned char *p, boost::uint16_t v)
+    {
+        p[0] = static_cast<unsigned char>(v);
+        p[1] = static_cast<unsigned char>(v >> 8);
+    };
+
+    static void put32(unsigned char *p, boost::uint32_t v)
+    {
+        put16(p, static_cast<boost::uint16_t>(v));
+        put16(p + 2, static_cast<boost::uint16_t>(v >> 16));
+    };
+};
+
+#endif // __CUBX_H__
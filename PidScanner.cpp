@@ -9,9 +9,228 @@
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string.hpp>
 #include <string>
+#include <algorithm>
 
 using namespace std;
 using namespace boost;
+
+// PIDs polled by Poll()
+static const int POLLED_PIDS[] =
+{
+    CPidScanner::OBDII_PID_FUEL_LEVEL_INPUT,
+    CPidScanner::OBDII_PID_ENGINE_RPM,
+    CPidScanner::OBDII_PID_VEHICLE_SPEED,
+    CPidScanner::OBDII_PID_THROTTLE_POSITION,
+    CPidScanner::OBDII_PID_ECU_VOLTAGE
+};
+static const size_t POLLED_COUNT = sizeof(POLLED_PIDS) / sizeof(POLLED_PIDS[0]);
+
+// Mode 01 PIDs of SAE J1979 00-C4, indexed by PID. PIDs of several
+// quantities decode the first one, those that start with a support byte
+// are bit-encoded. Size 0: not defined, or the size is not published (C3,
+// C4).
+// { pid, size, valueSize, isSigned, scale, offset, units, name }
+static const CPidScanner::PidInfo PID_TABLE[] =
+{
+    { 0x00, 4, 4, false, 1,           0,    "",      "PIDs supported 01-20" },
+    { 0x01, 4, 4, false, 1,           0,    "",      "Monitor status since DTCs cleared" },
+    { 0x02, 2, 2, false, 1,           0,    "",      "Freeze DTC" },
+    { 0x03, 2, 2, false, 1,           0,    "",      "Fuel system status" },
+    { 0x04, 1, 1, false, 100.0 / 255, 0,    "%",     "Calculated engine load" },
+    { 0x05, 1, 1, false, 1,           -40,  "degC",  "Engine coolant temperature" },
+    { 0x06, 1, 1, false, 100.0 / 128, -100, "%",     "Short term fuel trim, bank 1" },
+    { 0x07, 1, 1, false, 100.0 / 128, -100, "%",     "Long term fuel trim, bank 1" },
+    { 0x08, 1, 1, false, 100.0 / 128, -100, "%",     "Short term fuel trim, bank 2" },
+    { 0x09, 1, 1, false, 100.0 / 128, -100, "%",     "Long term fuel trim, bank 2" },
+    { 0x0A, 1, 1, false, 3,           0,    "kPa",   "Fuel pressure" },
+    { 0x0B, 1, 1, false, 1,           0,    "kPa",   "Intake manifold absolute pressure" },
+    { 0x0C, 2, 2, false, 0.25,        0,    "rpm",   "Engine RPM" },
+    { 0x0D, 1, 1, false, 1,           0,    "km/h",  "Vehicle speed" },
+    { 0x0E, 1, 1, false, 0.5,         -64,  "deg",   "Timing advance" },
+    { 0x0F, 1, 1, false, 1,           -40,  "degC",  "Intake air temperature" },
+    { 0x10, 2, 2, false, 0.01,        0,    "g/s",   "MAF air flow rate" },
+    { 0x11, 1, 1, false, 100.0 / 255, 0,    "%",     "Throttle position" },
+    { 0x12, 1, 1, false, 1,           0,    "",      "Commanded secondary air status" },
+    { 0x13, 1, 1, false, 1,           0,    "",      "Oxygen sensors present, 2 banks" },
+    { 0x14, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 1 voltage" },
+    { 0x15, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 2 voltage" },
+    { 0x16, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 3 voltage" },
+    { 0x17, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 4 voltage" },
+    { 0x18, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 5 voltage" },
+    { 0x19, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 6 voltage" },
+    { 0x1A, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 7 voltage" },
+    { 0x1B, 2, 1, false, 0.005,       0,    "V",     "Oxygen sensor 8 voltage" },
+    { 0x1C, 1, 1, false, 1,           0,    "",      "OBD standards" },
+    { 0x1D, 1, 1, false, 1,           0,    "",      "Oxygen sensors present, 4 banks" },
+    { 0x1E, 1, 1, false, 1,           0,    "",      "Auxiliary input status" },
+    { 0x1F, 2, 2, false, 1,           0,    "s",     "Run time since engine start" },
+    { 0x20, 4, 4, false, 1,           0,    "",      "PIDs supported 21-40" },
+    { 0x21, 2, 2, false, 1,           0,    "km",    "Distance traveled with MIL on" },
+    { 0x22, 2, 2, false, 0.079,       0,    "kPa",   "Fuel rail pressure, relative to manifold vacuum" },
+    { 0x23, 2, 2, false, 10,          0,    "kPa",   "Fuel rail gauge pressure" },
+    { 0x24, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 1 equivalence ratio" },
+    { 0x25, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 2 equivalence ratio" },
+    { 0x26, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 3 equivalence ratio" },
+    { 0x27, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 4 equivalence ratio" },
+    { 0x28, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 5 equivalence ratio" },
+    { 0x29, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 6 equivalence ratio" },
+    { 0x2A, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 7 equivalence ratio" },
+    { 0x2B, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 8 equivalence ratio" },
+    { 0x2C, 1, 1, false, 100.0 / 255, 0,    "%",     "Commanded EGR" },
+    { 0x2D, 1, 1, false, 100.0 / 128, -100, "%",     "EGR error" },
+    { 0x2E, 1, 1, false, 100.0 / 255, 0,    "%",     "Commanded evaporative purge" },
+    { 0x2F, 1, 1, false, 100.0 / 255, 0,    "%",     "Fuel tank level input" },
+    { 0x30, 1, 1, false, 1,           0,    "",      "Warm-ups since codes cleared" },
+    { 0x31, 2, 2, false, 1,           0,    "km",    "Distance traveled since codes cleared" },
+    { 0x32, 2, 2, true,  0.25,        0,    "Pa",    "Evap. system vapor pressure" },
+    { 0x33, 1, 1, false, 1,           0,    "kPa",   "Absolute barometric pressure" },
+    { 0x34, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 1 equivalence ratio, current sensor" },
+    { 0x35, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 2 equivalence ratio, current sensor" },
+    { 0x36, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 3 equivalence ratio, current sensor" },
+    { 0x37, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 4 equivalence ratio, current sensor" },
+    { 0x38, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 5 equivalence ratio, current sensor" },
+    { 0x39, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 6 equivalence ratio, current sensor" },
+    { 0x3A, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 7 equivalence ratio, current sensor" },
+    { 0x3B, 4, 2, false, 2.0 / 65536, 0,    "ratio", "Oxygen sensor 8 equivalence ratio, current sensor" },
+    { 0x3C, 2, 2, false, 0.1,         -40,  "degC",  "Catalyst temperature, bank 1 sensor 1" },
+    { 0x3D, 2, 2, false, 0.1,         -40,  "degC",  "Catalyst temperature, bank 2 sensor 1" },
+    { 0x3E, 2, 2, false, 0.1,         -40,  "degC",  "Catalyst temperature, bank 1 sensor 2" },
+    { 0x3F, 2, 2, false, 0.1,         -40,  "degC",  "Catalyst temperature, bank 2 sensor 2" },
+    { 0x40, 4, 4, false, 1,           0,    "",      "PIDs supported 41-60" },
+    { 0x41, 4, 4, false, 1,           0,    "",      "Monitor status this drive cycle" },
+    { 0x42, 2, 2, false, 0.001,       0,    "V",     "Control module voltage" },
+    { 0x43, 2, 2, false, 100.0 / 255, 0,    "%",     "Absolute load value" },
+    { 0x44, 2, 2, false, 2.0 / 65536, 0,    "ratio", "Commanded air-fuel equivalence ratio" },
+    { 0x45, 1, 1, false, 100.0 / 255, 0,    "%",     "Relative throttle position" },
+    { 0x46, 1, 1, false, 1,           -40,  "degC",  "Ambient air temperature" },
+    { 0x47, 1, 1, false, 100.0 / 255, 0,    "%",     "Absolute throttle position B" },
+    { 0x48, 1, 1, false, 100.0 / 255, 0,    "%",     "Absolute throttle position C" },
+    { 0x49, 1, 1, false, 100.0 / 255, 0,    "%",     "Accelerator pedal position D" },
+    { 0x4A, 1, 1, false, 100.0 / 255, 0,    "%",     "Accelerator pedal position E" },
+    { 0x4B, 1, 1, false, 100.0 / 255, 0,    "%",     "Accelerator pedal position F" },
+    { 0x4C, 1, 1, false, 100.0 / 255, 0,    "%",     "Commanded throttle actuator" },
+    { 0x4D, 2, 2, false, 1,           0,    "min",   "Time run with MIL on" },
+    { 0x4E, 2, 2, false, 1,           0,    "min",   "Time since trouble codes cleared" },
+    { 0x4F, 4, 1, false, 1,           0,    "ratio", "Maximum equivalence ratio" },
+    { 0x50, 4, 1, false, 10,          0,    "g/s",   "Maximum MAF air flow rate" },
+    { 0x51, 1, 1, false, 1,           0,    "",      "Fuel type" },
+    { 0x52, 1, 1, false, 100.0 / 255, 0,    "%",     "Ethanol fuel" },
+    { 0x53, 2, 2, false, 0.005,       0,    "kPa",   "Absolute evap. system vapor pressure" },
+    { 0x54, 2, 2, true,  1,           0,    "Pa",    "Evap. system vapor pressure" },
+    { 0x55, 2, 1, false, 100.0 / 128, -100, "%",     "Short term secondary oxygen sensor trim, bank 1" },
+    { 0x56, 2, 1, false, 100.0 / 128, -100, "%",     "Long term secondary oxygen sensor trim, bank 1" },
+    { 0x57, 2, 1, false, 100.0 / 128, -100, "%",     "Short term secondary oxygen sensor trim, bank 2" },
+    { 0x58, 2, 1, false, 100.0 / 128, -100, "%",     "Long term secondary oxygen sensor trim, bank 2" },
+    { 0x59, 2, 2, false, 10,          0,    "kPa",   "Fuel rail absolute pressure" },
+    { 0x5A, 1, 1, false, 100.0 / 255, 0,    "%",     "Relative accelerator pedal position" },
+    { 0x5B, 1, 1, false, 100.0 / 255, 0,    "%",     "Hybrid battery pack remaining life" },
+    { 0x5C, 1, 1, false, 1,           -40,  "degC",  "Engine oil temperature" },
+    { 0x5D, 2, 2, false, 1.0 / 128,   -210, "deg",   "Fuel injection timing" },
+    { 0x5E, 2, 2, false, 0.05,        0,    "L/h",   "Engine fuel rate" },
+    { 0x5F, 1, 1, false, 1,           0,    "",      "Emission requirements" },
+    { 0x60, 4, 4, false, 1,           0,    "",      "PIDs supported 61-80" },
+    { 0x61, 1, 1, false, 1,           -125, "%",     "Driver's demand engine percent torque" },
+    { 0x62, 1, 1, false, 1,           -125, "%",     "Actual engine percent torque" },
+    { 0x63, 2, 2, false, 1,           0,    "Nm",    "Engine reference torque" },
+    { 0x64, 5, 1, false, 1,           -125, "%",     "Engine percent torque, idle" },
+    { 0x65, 2, 2, false, 1,           0,    "",      "Auxiliary input / output supported" },
+    { 0x66, 5, 4, false, 1,           0,    "",      "Mass air flow sensor" },
+    { 0x67, 3, 3, false, 1,           0,    "",      "Engine coolant temperature, sensors" },
+    { 0x68, 3, 3, false, 1,           0,    "",      "Intake air temperature, sensors" },
+    { 0x69, 7, 4, false, 1,           0,    "",      "Actual EGR, commanded EGR, EGR error" },
+    { 0x6A, 5, 4, false, 1,           0,    "",      "Commanded diesel intake air flow control" },
+    { 0x6B, 5, 4, false, 1,           0,    "",      "Exhaust gas recirculation temperature" },
+    { 0x6C, 5, 4, false, 1,           0,    "",      "Commanded throttle actuator control" },
+    { 0x6D, 11, 4, false, 1,           0,    "",      "Fuel pressure control system" },
+    { 0x6E, 9, 4, false, 1,           0,    "",      "Injection pressure control system" },
+    { 0x6F, 3, 3, false, 1,           0,    "",      "Turbocharger compressor inlet pressure" },
+    { 0x70, 10, 4, false, 1,           0,    "",      "Boost pressure control" },
+    { 0x71, 6, 4, false, 1,           0,    "",      "Variable geometry turbo control" },
+    { 0x72, 5, 4, false, 1,           0,    "",      "Wastegate control" },
+    { 0x73, 5, 4, false, 1,           0,    "",      "Exhaust pressure" },
+    { 0x74, 5, 4, false, 1,           0,    "",      "Turbocharger RPM" },
+    { 0x75, 7, 4, false, 1,           0,    "",      "Turbocharger temperature" },
+    { 0x76, 7, 4, false, 1,           0,    "",      "Turbocharger temperature" },
+    { 0x77, 5, 4, false, 1,           0,    "",      "Charge air cooler temperature" },
+    { 0x78, 9, 4, false, 1,           0,    "",      "Exhaust gas temperature, bank 1" },
+    { 0x79, 9, 4, false, 1,           0,    "",      "Exhaust gas temperature, bank 2" },
+    { 0x7A, 7, 4, false, 1,           0,    "",      "Diesel particulate filter differential pressure" },
+    { 0x7B, 7, 4, false, 1,           0,    "",      "Diesel particulate filter" },
+    { 0x7C, 9, 4, false, 1,           0,    "",      "Diesel particulate filter temperature" },
+    { 0x7D, 1, 1, false, 1,           0,    "",      "NOx NTE control area status" },
+    { 0x7E, 1, 1, false, 1,           0,    "",      "PM NTE control area status" },
+    { 0x7F, 13, 4, false, 1,           0,    "",      "Engine run time" },
+    { 0x80, 4, 4, false, 1,           0,    "",      "PIDs supported 81-A0" },
+    { 0x81, 41, 4, false, 1,           0,    "",      "Engine run time for AECD #1-#5" },
+    { 0x82, 41, 4, false, 1,           0,    "",      "Engine run time for AECD #6-#10" },
+    { 0x83, 9, 4, false, 1,           0,    "",      "NOx sensor" },
+    { 0x84, 1, 1, false, 1,           -40,  "degC",  "Manifold surface temperature" },
+    { 0x85, 10, 4, false, 1,           0,    "",      "NOx reagent system" },
+    { 0x86, 5, 4, false, 1,           0,    "",      "Particulate matter sensor" },
+    { 0x87, 5, 4, false, 1,           0,    "",      "Intake manifold absolute pressure, sensors" },
+    { 0x88, 13, 4, false, 1,           0,    "",      "SCR inducement system" },
+    { 0x89, 41, 4, false, 1,           0,    "",      "Engine run time for AECD #11-#15" },
+    { 0x8A, 41, 4, false, 1,           0,    "",      "Engine run time for AECD #16-#20" },
+    { 0x8B, 7, 4, false, 1,           0,    "",      "Diesel aftertreatment" },
+    { 0x8C, 17, 4, false, 1,           0,    "",      "Oxygen sensor, wide range" },
+    { 0x8D, 1, 1, false, 100.0 / 255, 0,    "%",     "Throttle position G" },
+    { 0x8E, 1, 1, false, 1,           -125, "%",     "Engine friction percent torque" },
+    { 0x8F, 7, 4, false, 1,           0,    "",      "Particulate matter sensor, banks 1 and 2" },
+    { 0x90, 3, 3, false, 1,           0,    "",      "WWH-OBD vehicle OBD system information" },
+    { 0x91, 5, 4, false, 1,           0,    "",      "WWH-OBD ECU OBD system information" },
+    { 0x92, 2, 2, false, 1,           0,    "",      "Fuel system control" },
+    { 0x93, 3, 3, false, 1,           0,    "",      "WWH-OBD counters support" },
+    { 0x94, 12, 4, false, 1,           0,    "",      "NOx warning and inducement system" },
+    { 0x95, 0, 0, false, 1,           0,    "",      "" },
+    { 0x96, 0, 0, false, 1,           0,    "",      "" },
+    { 0x97, 0, 0, false, 1,           0,    "",      "" },
+    { 0x98, 9, 4, false, 1,           0,    "",      "Exhaust gas temperature sensor, bank 1" },
+    { 0x99, 9, 4, false, 1,           0,    "",      "Exhaust gas temperature sensor, bank 2" },
+    { 0x9A, 6, 4, false, 1,           0,    "",      "Hybrid/EV system data, battery, voltage" },
+    { 0x9B, 4, 4, false, 1,           0,    "",      "Diesel exhaust fluid sensor data" },
+    { 0x9C, 17, 4, false, 1,           0,    "",      "Oxygen sensor data" },
+    { 0x9D, 4, 2, false, 0.02,        0,    "g/s",   "Engine fuel rate" },
+    { 0x9E, 2, 2, false, 0.2,         0,    "kg/h",  "Engine exhaust flow rate" },
+    { 0x9F, 9, 4, false, 1,           0,    "",      "Fuel system percentage use" },
+    { 0xA0, 4, 4, false, 1,           0,    "",      "PIDs supported A1-C0" },
+    { 0xA1, 9, 4, false, 1,           0,    "",      "NOx sensor corrected data" },
+    { 0xA2, 2, 2, false, 1.0 / 32,    0,    "mg",    "Cylinder fuel rate" },
+    { 0xA3, 9, 4, false, 1,           0,    "",      "Evap. system vapor pressure, sensors" },
+    { 0xA4, 4, 4, false, 1,           0,    "",      "Transmission actual gear" },
+    { 0xA5, 4, 4, false, 1,           0,    "",      "Commanded diesel exhaust fluid dosing" },
+    { 0xA6, 4, 4, false, 0.1,         0,    "km",    "Odometer" },
+    { 0xA7, 4, 4, false, 1,           0,    "",      "NOx sensor concentration, sensors 3 and 4" },
+    { 0xA8, 4, 4, false, 1,           0,    "",      "NOx sensor corrected concentration, sensors 3 and 4" },
+    { 0xA9, 4, 4, false, 1,           0,    "",      "ABS disable switch state" },
+    { 0xAA, 0, 0, false, 1,           0,    "",      "" },
+    { 0xAB, 0, 0, false, 1,           0,    "",      "" },
+    { 0xAC, 0, 0, false, 1,           0,    "",      "" },
+    { 0xAD, 0, 0, false, 1,           0,    "",      "" },
+    { 0xAE, 0, 0, false, 1,           0,    "",      "" },
+    { 0xAF, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB0, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB1, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB2, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB3, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB4, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB5, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB6, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB7, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB8, 0, 0, false, 1,           0,    "",      "" },
+    { 0xB9, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBA, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBB, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBC, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBD, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBE, 0, 0, false, 1,           0,    "",      "" },
+    { 0xBF, 0, 0, false, 1,           0,    "",      "" },
+    { 0xC0, 4, 4, false, 1,           0,    "",      "PIDs supported C1-E0" },
+    { 0xC1, 0, 0, false, 1,           0,    "",      "" },
+    { 0xC2, 0, 0, false, 1,           0,    "",      "" },
+    { 0xC3, 0, 0, false, 1,           0,    "",      "" },
+    { 0xC4, 0, 0, false, 1,           0,    "",      "" },
+};
+static const size_t PID_TABLE_SIZE = sizeof(PID_TABLE) / sizeof(PID_TABLE[0]);
 // --------------------------------------------------------------
 int CPidScanner::Init()
 {
@@ -21,18 +240,29 @@ int CPidScanner::Init()
    {
       RESET_SEND,
       CUSTOM_INIT,
+      OUTPUT_FORMAT,
       WAIT_ECU_TIMEOUT,
       DETECT_PROTOCOL,
+      LEARN_RESPONSES,
       END_INIT
    };
 
    m_initialized = true;
+   m_noDataPolls = 0;
 
    if( ! m_port.isOpen())
    {
       return 2;
    }
 
+   // ATZ restores the adapter timing
+   m_st = 0;
+   m_tunedSt = 0;
+   m_requestTimeout = AT_TIMEOUT;
+   m_tuneCycles = m_adaptiveTiming ? TUNE_CYCLES : 0;
+   m_minLatency = CByteStream::Clock::duration::max();
+   m_maxLatency = CByteStream::Clock::duration::zero();
+
    InitState state = RESET_SEND;
    // ATZ, reset to NVRAM default
    std::string cmd;
@@ -70,7 +300,7 @@ int CPidScanner::Init()
             || INTERFACE_ELM322 == resp_status
             || INTERFACE_ELM320 == resp_status)
          {
-            state = WAIT_ECU_TIMEOUT;
+            state = OUTPUT_FORMAT;
          }
          else if(resp_status == UNKNOWN_CMD)
          {
@@ -84,8 +314,19 @@ int CPidScanner::Init()
             return 1;
          }
          break;
+      case OUTPUT_FORMAT:
+         // adapters before v1.3 do not know ATS0, they keep the spaces
+         if(OK != sendExpect(m_compact ? "ATS0" : "ATS1", ">", rcv_str, AT_TIMEOUT))
+         {
+            m_compact = false;
+         }
+         // headers off and CAN formatting on are the defaults anyway
+         sendExpect("ATH0", ">", rcv_str, AT_TIMEOUT);
+         sendExpect("ATCAF1", ">", rcv_str, AT_TIMEOUT);
+         state = WAIT_ECU_TIMEOUT;
+         break;
       case WAIT_ECU_TIMEOUT:
-         boost::this_thread::sleep(boost::posix_time::millisec(ECU_TIMEOUT));
+         boost::this_thread::sleep(boost::posix_time::millisec(static_cast<long>(ECU_TIMEOUT)));
          state = DETECT_PROTOCOL;
          break;
       case DETECT_PROTOCOL:
@@ -95,6 +336,22 @@ int CPidScanner::Init()
          {
              return 1;
          }
+         // multi-PID requests are supported on CAN only
+         m_multiPid = (HEX_DATA == sendExpect("ATDPN", ">", rcv_str, AT_TIMEOUT)) && isCanProtocol(rcv_str);
+         state = LEARN_RESPONSES;
+         break;
+      case LEARN_RESPONSES:
+         // one poll of each request, without count suffix, learns how
+         // many ECUs answer it
+         m_responses.clear();
+         if(m_multiPid && pollPids(POLLED_PIDS, POLLED_COUNT) < 0)
+         {
+            m_multiPid = false;
+         }
+         for(size_t i = 0; i < POLLED_COUNT; i++)
+         {
+            pollValue(POLLED_PIDS[i]);
+         }
          state = END_INIT;
          break;
       case END_INIT:
@@ -112,200 +369,538 @@ int CPidScanner::Init()
 // --------------------------------------------------------------
 float CPidScanner::getSpeed(bool & present)
 {
-    present = m_speed.present;
-    return m_speed.value;
+    return static_cast<float>(getValue(OBDII_PID_VEHICLE_SPEED, present));
 }
 // --------------------------------------------------------------
 float CPidScanner::getRpm(bool & present)
 {
-    present = m_rpm.present;
-    return m_rpm.value;
+    return static_cast<float>(getValue(OBDII_PID_ENGINE_RPM, present));
 }
 // --------------------------------------------------------------
 float CPidScanner::getFuel(bool & present)
 {
-    present = m_fuel.present;
-    return m_fuel.value;
+    return static_cast<float>(getValue(OBDII_PID_FUEL_LEVEL_INPUT, present));
 }
 // --------------------------------------------------------------
 float CPidScanner::getThrottle(bool & present)
 {
-    present = m_throttle.present;
-    return m_throttle.value;
+    return static_cast<float>(getValue(OBDII_PID_THROTTLE_POSITION, present));
 }
 // --------------------------------------------------------------
 float CPidScanner::getOdometer(bool & present)
 {
-    present = m_odometer.present;
-    return m_odometer.value;
+    return static_cast<float>(getValue(OBDII_PID_ODOMETER, present));
 }
 // --------------------------------------------------------------
 float CPidScanner::getVoltage(bool & present)
 {
-    present = m_voltage.present;
-    return m_voltage.value;
+    return static_cast<float>(getValue(OBDII_PID_ECU_VOLTAGE, present));
 }
 // --------------------------------------------------------------
-bool CPidScanner::pollSpeed()
+double CPidScanner::getValue(int pid, bool & present) const
 {
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_VEHICLE_SPEED;
-    bool ret = false;
-
-    m_speed.present = false;
-    if((ret = pollPid(mode, pid, pid_str)))
+    const pid_elem & elem = m_values[pid & 0xFF];
+    present = elem.present;
+    return elem.value;
+}
+// --------------------------------------------------------------
+CByteStream::Clock::duration CPidScanner::getAge(OBD_Pid pid) const
+{
+    const pid_elem & elem = m_values[pid & 0xFF];
+    if(elem.received == CByteStream::Clock::time_point())
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // 01 	0D 	1 	Vehicle speed 	0 	255 	km/h 	A
-
-       m_speed.value = val;
-       m_speed.present = true;
+        return CByteStream::Clock::duration::max();
     }
-    return ret;
+    return CByteStream::Clock::now() - elem.received;
 }
 // --------------------------------------------------------------
-bool CPidScanner::pollRpm()
+CByteStream::Clock::duration CPidScanner::getDataAge() const
 {
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_ENGINE_RPM;
-    bool ret = false;
-
-    m_rpm.present = false;
-    if((ret = pollPid(mode, pid, pid_str)))
+    return CByteStream::Clock::now() - m_received;
+}
+// --------------------------------------------------------------
+const CPidScanner::PidInfo * CPidScanner::pidInfo(int pid)
+{
+    if(pid >= 0 && static_cast<size_t>(pid) < PID_TABLE_SIZE && PID_TABLE[pid].size > 0)
+    {
+        return &PID_TABLE[pid];
+    }
+    return NULL;
+}
+// --------------------------------------------------------------
+bool CPidScanner::storePid(int pid, const unsigned char *data, size_t size)
+{
+    const PidInfo *info = pidInfo(pid);
+    if(!info || size < info->valueSize)
+    {
+        return false;
+    }
+    uint32_t raw = 0;
+    for(size_t k = 0; k < info->valueSize; k++)
+    {
+        raw = (raw << 8) | data[k];
+    }
+    double val = raw;
+    if(info->isSigned && (raw >> (info->valueSize * 8 - 1)))
+    {
+        val -= 256.0 * (1UL << ((info->valueSize - 1) * 8)); // two's complement
+    }
+    pid_elem & elem = m_values[pid];
+    elem.value = val * info->scale + info->offset;
+    elem.present = true;
+    elem.received = m_received;
+    return true;
+}
+// --------------------------------------------------------------
+bool CPidScanner::pollValue(int pid)
+{
+    unsigned char data[8];
+    m_values[pid & 0xFF].present = false;
+    size_t size = pollPid(OBDII_MODE_SHOW_CURRENT_DATA, pid, data, sizeof(data));
+    return size > 0 && storePid(pid, data, size);
+}
+// --------------------------------------------------------------
+bool CPidScanner::pollPid(int mode, int pid, std::string & pid_str)
+{
+    unsigned char data[4];
+    size_t size = pollPid(mode, pid, data, sizeof(data));
+    if(!size)
+    {
+        return false;
+    }
+    static const char digits[] = "0123456789ABCDEF";
+    pid_str.clear();
+    for(size_t i = 0; i < size; i++)
+    {
+        pid_str += digits[data[i] >> 4];
+        pid_str += digits[data[i] & 0x0F];
+    }
+    return true;
+}
+// --------------------------------------------------------------
+bool CPidScanner::pollPid(int mode, int pid, uint32_t & val)
+{
+    unsigned char data[4];
+    size_t size = pollPid(mode, pid, data, sizeof(data));
+    val = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        val = (val << 8) | data[i];
+    }
+    return size > 0;
+}
+// --------------------------------------------------------------
+size_t CPidScanner::pollPid(int mode, int pid, unsigned char *data, size_t capacity)
+{
+    std::string resp_str;
+    std::string cmd = str( boost::format("%02X%02X") % mode % pid );
+    if(HEX_DATA != sendRequest(cmd, resp_str))
+    {
+        return 0;
+    }
+    // mode + 0x40, pid, data bytes
+    unsigned char buf[64];
+    size_t size = decodeResponse(resp_str, buf, sizeof(buf));
+    if(size < 3 || mode != (buf[0] & ~0x40) || buf[1] != pid)
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // 01 	0C 	2 	Engine RPM 	0 	16,383.75 	rpm 	((A*256)+B)/4
-       // Note: (A*256)+B already done in pollPid()
-       m_rpm.value = val >> 2;
-       m_rpm.present = true;
+        return 0;
     }
-    return ret;
+    size = std::min(size - 2, capacity);
+    std::copy(buf + 2, buf + 2 + size, data);
+    m_received = m_port.getReceiveTime();
+    return size;
 }
+
 // --------------------------------------------------------------
-bool CPidScanner::pollFuel()
+int CPidScanner::pollPids(const int *pids, size_t count)
 {
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_FUEL_LEVEL_INPUT;
-    bool ret = false;
+    // Group the PIDs to requests. With the count suffix each response must
+    // fit one CAN frame, so that the count of responses is unambiguous:
+    // first fit, largest PIDs first. Otherwise the fewest requests are sent.
+    std::vector<std::string> cmds;
+    std::vector<size_t> room, pids_in;
+    for(size_t i = 0; i < count; i++)
+    {
+        m_values[pids[i] & 0xFF].present = false;
+    }
+    const size_t MAX_NEED = SINGLE_FRAME_DATA; // PID and up to 5 data bytes
+    for(size_t k = 0; k < count * MAX_NEED; k++)
+    {
+        size_t i = k % count;
+        const PidInfo *info = pidInfo(pids[i]);
+        size_t need = info ? std::min(1 + info->size, MAX_NEED) : MAX_NEED;
+        if(m_countSuffix ? need != MAX_NEED - k / count : k >= count)
+        {
+            continue;
+        }
+        size_t g = 0;
+        if(m_countSuffix)
+        {
+            while(g < cmds.size() && (room[g] < need || pids_in[g] == MAX_PIDS_PER_REQUEST))
+            {
+                g++;
+            }
+        }
+        else if(!cmds.empty())
+        {
+            g = (pids_in.back() == MAX_PIDS_PER_REQUEST) ? cmds.size() : cmds.size() - 1;
+        }
+        if(g == cmds.size())
+        {
+            cmds.push_back(str( boost::format("%02X") % OBDII_MODE_SHOW_CURRENT_DATA ));
+            room.push_back(SINGLE_FRAME_DATA);
+            pids_in.push_back(0);
+        }
+        cmds[g] += str( boost::format("%02X") % pids[i] );
+        room[g] -= std::min(need, room[g]);
+        pids_in[g]++;
+    }
 
-    m_fuel.present = false;
-    if((ret = pollPid(mode, pid, pid_str)))
+    int received = 0;
+    bool answered = false, failed = false;
+    for(size_t g = 0; g < cmds.size(); g++)
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // 01 	2F 	1 	Fuel Level Input 	0 	100 	 % 	100*A/255
-       m_fuel.value = (float)val / 2.55; // value in % of full tank
-       m_fuel.present = true;
+        std::string resp_str;
+        ResponseStatus resp_status = sendRequest(cmds[g], resp_str);
+        if(ERR_NO_DATA == resp_status)
+        {
+            continue; // none of the PIDs supported, or a legacy ECU
+        }
+        if(UNKNOWN_CMD == resp_status)
+        {
+            return -1; // adapter without multi-PID requests
+        }
+        unsigned char data[64];
+        size_t size = 0;
+        if(HEX_DATA == resp_status)
+        {
+            size = decodeResponse(resp_str, data, sizeof(data));
+        }
+        if(size < 1 || data[0] != (OBDII_MODE_SHOW_CURRENT_DATA | 0x40))
+        {
+            if(size >= 1 && data[0] == NEGATIVE_RESPONSE)
+            {
+                return -1; // the ECU rejects the request
+            }
+            // timeout, BUS BUSY, CAN ERROR, SEARCHING...: this cycle only
+            failed = true;
+            continue;
+        }
+        m_received = m_port.getReceiveTime();
+        answered = true;
+
+        // 41 pid data... pid data...
+        for(size_t pos = 1; pos < size; )
+        {
+            const PidInfo *info = pidInfo(data[pos]);
+            if(!info || pos + 1 + info->size > size)
+            {
+                break;
+            }
+            if(storePid(data[pos], data + pos + 1, info->size))
+            {
+                received++;
+            }
+            pos += 1 + info->size;
+        }
     }
-    return ret;
+    // legacy ECUs answer multi-PID requests with NO DATA only
+    if(answered || cmds.empty())
+    {
+        m_noDataPolls = 0;
+    }
+    else if(!failed && ++m_noDataPolls >= NO_DATA_POLLS)
+    {
+        return -1;
+    }
+    return received;
 }
+
 // --------------------------------------------------------------
-bool CPidScanner::pollThrottle()
+CPidScanner::ResponseStatus CPidScanner::sendRequest(const std::string & cmd, std::string & resp_str, bool retry)
 {
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_THROTTLE_POSITION;
-    bool ret = false;
+    ResponseStatus resp_status;
+    std::map<std::string, int>::const_iterator it = m_responses.find(cmd);
+    if(it == m_responses.end())
+    {
+        resp_status = sendExpect(cmd, ">", resp_str, m_requestTimeout);
+        if(HEX_DATA == resp_status)
+        {
+            m_responses[cmd] = countResponses(resp_str);
+        }
+        return resp_status;
+    }
+    resp_status = UNKNOWN_CMD;
+    if(m_countSuffix && it->second > 0 && it->second <= 0x0F)
+    {
+        CByteStream::Clock::time_point sent = CByteStream::Clock::now();
+        resp_status = sendExpect(cmd + str( boost::format("%X") % it->second ), ">", resp_str, m_requestTimeout);
+        if(HEX_DATA == resp_status && m_tuneCycles > 0)
+        {
+            // the prompt follows the last expected response at once, no
+            // adapter timeout in this time
+            sampleLatency(m_port.getReceiveTime() - sent);
+        }
+        else if(UNKNOWN_CMD == resp_status)
+        {
+            m_countSuffix = false; // adapter older than v1.3
+        }
+    }
+    if(UNKNOWN_CMD == resp_status)
+    {
+        resp_status = sendExpect(cmd, ">", resp_str, m_requestTimeout);
+    }
+    if(ERR_NO_DATA == resp_status && retry && backOff())
+    {
+        // answered before, the adapter timeout may be too short now
+        return sendRequest(cmd, resp_str, false);
+    }
+    if(HEX_DATA == resp_status)
+    {
+        restoreTiming();
+    }
+    return resp_status;
+}
 
-    m_throttle.present = false;
-    if((ret = pollPid(mode, pid, pid_str)))
+// --------------------------------------------------------------
+void CPidScanner::setCompactOutput(bool on)
+{
+    m_compact = on;
+    if(m_initialized && m_port.isOpen())
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // 01 	11 	1 	Throttle position 	0 	100 	 % 	A*100/255
-       m_throttle.value = (float)val / 2.55;
-       m_throttle.present = true;
+        std::string resp_str;
+        if(OK != sendExpect(on ? "ATS0" : "ATS1", ">", resp_str, AT_TIMEOUT))
+        {
+            m_compact = false; // adapter before v1.3 keeps the spaces
+        }
     }
-    return ret;
 }
+
 // --------------------------------------------------------------
-bool CPidScanner::pollOdometer()
+void CPidScanner::setAdaptiveTiming(bool on)
 {
-    bool ret = false;
+    m_adaptiveTiming = on;
+    m_tuneCycles = on ? TUNE_CYCLES : 0;
+    m_minLatency = CByteStream::Clock::duration::max();
+    m_maxLatency = CByteStream::Clock::duration::zero();
+    if(!on && m_st != 0)
+    {
+        std::string resp_str;
+        sendExpect("ATAT1", ">", resp_str, AT_TIMEOUT);
+        setAdapterTimeout(ST_DEFAULT);
+        m_st = 0;
+    }
+    m_tunedSt = 0;
+}
 
-    m_odometer.present = false;
+// --------------------------------------------------------------
+void CPidScanner::sampleLatency(CByteStream::Clock::duration latency)
+{
+    m_minLatency = std::min(m_minLatency, latency);
+    m_maxLatency = std::max(m_maxLatency, latency);
+}
 
-    // TODO: no standard PID for odometer :-( so we need some replacement
-    // TODO: remove next line from production code
-#ifndef PRODUCTION_CODE
-    return ret;
+// --------------------------------------------------------------
+void CPidScanner::applyTiming()
+{
+    if(m_maxLatency <= CByteStream::Clock::duration::zero())
+    {
+        return; // no request with the count suffix, nothing to go by
+    }
+    // slowest response with margin, rounded up to ATST units
+    long max_ms = static_cast<long>(boost::chrono::duration_cast<boost::chrono::microseconds>(m_maxLatency).count() / 1000) + 1;
+    int st = static_cast<int>((max_ms * TIMING_MARGIN + ST_UNIT_MS - 1) / ST_UNIT_MS);
+    st = std::max(1, std::min(st, static_cast<int>(ST_MAX)));
 
-#else
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_????;
+    // ATAT2 waits less than ATAT1, only for ECUs that answer steadily
+    std::string resp_str;
+    std::string at = (m_maxLatency < m_minLatency * 2) ? "ATAT2" : "ATAT1";
+    if(OK != sendExpect(at, ">", resp_str, AT_TIMEOUT))
+    {
+        return; // adapter without adaptive timing, keep the defaults
+    }
+    if(setAdapterTimeout(st))
+    {
+        m_tunedSt = st;
+    }
+}
 
-    if(ret = pollPid(mode, pid, pid_str))
+// --------------------------------------------------------------
+bool CPidScanner::setAdapterTimeout(int st)
+{
+    std::string resp_str;
+    if(OK != sendExpect(str( boost::format("ATST%02X") % st ), ">", resp_str, AT_TIMEOUT))
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // ???????
-       m_odometer.value = (float)val / 2.55;
-       m_odometer.present = true;
+        return false;
     }
-    return ret;
-#endif
+    m_st = st;
+    m_decayResponses = 0;
+    // the adapter may wait ATST for the first response and again after it
+    m_requestTimeout = 2 * st * ST_UNIT_MS + HOST_MARGIN_MS;
+    return true;
 }
+
 // --------------------------------------------------------------
-bool CPidScanner::pollVoltage()
+bool CPidScanner::backOff()
 {
-    std::string pid_str;
-    uint16_t mode = OBDII_MODE_SHOW_CURRENT_DATA;
-    uint16_t pid = OBDII_PID_ECU_VOLTAGE;
-    bool ret = false;
+    if(m_st == 0 || m_st >= ST_MAX)
+    {
+        return false;
+    }
+    m_tuneCycles = 0;
+    return setAdapterTimeout(std::min(2 * m_st, static_cast<int>(ST_MAX)));
+}
 
-    m_voltage.present = false;
-    if((ret = pollPid(mode, pid, pid_str)))
+// --------------------------------------------------------------
+void CPidScanner::restoreTiming()
+{
+    if(m_st <= m_tunedSt || ++m_decayResponses < DECAY_RESPONSES)
     {
-       char * ptr;
-       uint16_t val = (uint16_t)strtoul( pid_str.c_str(), & ptr, 16 );
-       // Mode(hex)   PID(hex)   Data bytes returned     Description     Min value   Max value   Units   Formula
-       // 01 	42 	2 	Control module voltage 	0 	65.535 	V 	((A*256)+B)/1000
-       m_voltage.value = (float)val * 1e-3;
-       m_voltage.present = true;
+        return;
     }
-    return ret;
+    setAdapterTimeout(std::max(m_st / 2, m_tunedSt));
 }
+
 // --------------------------------------------------------------
-bool CPidScanner::pollPid(int mode, int pid, std::string & pid_str)
+int CPidScanner::countResponses(const std::string & resp)
 {
-    ResponseStatus resp_status;
-    std::string resp_str;
-    bool ret = false;
+    int count = 0;
+    size_t pos = 0;
+    while(pos < resp.size())
+    {
+        size_t eol = resp.find('\r', pos);
+        if(eol == std::string::npos)
+        {
+            eol = resp.size();
+        }
+        size_t len = 0;
+        bool frame = false;
+        for(size_t i = pos; i < eol; i++)
+        {
+            if(resp[i] == ':')
+            {
+                frame = true;
+            }
+            else if(resp[i] > ' ')
+            {
+                len++;
+            }
+        }
+        pos = eol + 1;
+        if(frame || len == 3)
+        {
+            // whether the adapter counts the message or its frames
+            // differs between firmware versions, wait for the timeout
+            return 0;
+        }
+        if(len > 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
 
-    std::string cmd = str( boost::format("%02X %02X") % mode % pid ); 
-    resp_status = sendExpect(cmd, ">", resp_str, AT_TIMEOUT);
-    if(HEX_DATA == resp_status)
+// --------------------------------------------------------------
+int CPidScanner::getExpectedResponses(int pid) const
+{
+    std::map<std::string, int>::const_iterator it =
+        m_responses.find(str( boost::format("%02X%02X") % OBDII_MODE_SHOW_CURRENT_DATA % pid ));
+    return it != m_responses.end() ? it->second : 0;
+}
+
+// --------------------------------------------------------------
+int CPidScanner::hexNibble(char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    c |= 0x20; // lower case
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// --------------------------------------------------------------
+size_t CPidScanner::decodeResponse(const std::string & resp, unsigned char *data, size_t capacity)
+{
+    size_t size = 0;
+    size_t expected = 0;    // multi-frame byte count, 0 - single line
+    size_t line_start = 0;  // size at the start of the line
+    size_t digits = 0;      // hex digits of the line
+    size_t value = 0;       // the line as a number, for the byte count
+    bool frame = false;     // "n:" seen
+    const char *p = resp.data();
+    const char *end = p + resp.size();
+    for(;; p++)
     {
-        std::vector< std::string > split_vector;
-        boost::split( split_vector, resp_str, is_any_of(" "), token_compress_on );
-        if(split_vector.size() >= 3)
+        char c = (p < end) ? *p : '\r';
+        int nibble = hexNibble(c);
+        if(nibble >= 0)
+        {
+            // every second digit completes a byte
+            size_t i = line_start + digits / 2;
+            if(i < capacity)
+            {
+                data[i] = static_cast<unsigned char>((digits % 2) ? (data[i] | nibble) : (nibble << 4));
+                if(digits % 2)
+                {
+                    size = i + 1;
+                }
+            }
+            value = (value << 4) | nibble;
+            digits++;
+        }
+        else if(c == ':')
         {
-            char * ptr;
-            uint16_t mode_recv = (uint16_t)strtoul( split_vector[0].c_str(), & ptr, 16 ); 
-            uint16_t pid_recv  = (uint16_t)strtoul( split_vector[1].c_str(), & ptr, 16 ); 
-            if(mode == (mode_recv & ~0x40) && pid_recv == pid)
+            // "n:" of a multi-frame response, the frame index is no data
+            frame = true;
+            digits = 0;
+            size = line_start;
+        }
+        else if(c == '\r' || c == '\n')
+        {
+            if(digits > 0 && !frame)
             {
-                pid_str = split_vector[2];
-                if(split_vector.size() > 3)
+                if(line_start > 0)
+                {
+                    size = line_start; // response of another ECU
+                    break;
+                }
+                if(digits == 3)
                 {
-                    pid_str += split_vector[3];
+                    // byte count line, starts a multi-frame response
+                    expected = value;
+                    size = line_start;
                 }
-                ret = true;
+            }
+            line_start = size;
+            digits = 0;
+            value = 0;
+            frame = false;
+            if(p >= end)
+            {
+                break;
             }
         }
     }
-    return ret;
+    if(expected > 0 && expected < size)
+    {
+        size = expected; // drop padding of the last frame
+    }
+    return size;
+}
+
+// --------------------------------------------------------------
+bool CPidScanner::isCanProtocol(const std::string & resp)
+{
+    // "A6": protocol 6, found automatically
+    size_t last = resp.find_last_not_of(" \r\n>");
+    if(last == std::string::npos)
+    {
+        return false;
+    }
+    char p = toupper(resp[last]);
+    return (p >= '6' && p <= '9') || (p >= 'A' && p <= 'C');
 }
 
 // --------------------------------------------------------------
@@ -316,12 +911,23 @@ int CPidScanner::Poll()
     int rc = 0;
     if(isPollTime())
     {
-        pollFuel();
-        pollOdometer();
-        pollRpm();
-        pollSpeed();
-        pollThrottle();
-        pollVoltage();
+        if(m_multiPid && pollPids(POLLED_PIDS, POLLED_COUNT) < 0)
+        {
+            // adapter or protocol without multi-PID requests
+            m_multiPid = false;
+        }
+        // NO DATA only may be a legacy ECU, ask one by one as well
+        if(!m_multiPid || m_noDataPolls > 0)
+        {
+            for(size_t i = 0; i < POLLED_COUNT; i++)
+            {
+                pollValue(POLLED_PIDS[i]);
+            }
+        }
+        if(m_tuneCycles > 0 && --m_tuneCycles == 0)
+        {
+            applyTiming();
+        }
         rc = 1;
     }
     return rc;
@@ -362,9 +968,11 @@ CPidScanner::ResponseStatus CPidScanner::sendExpect(std::string cmd, std::string
 }
 
 // --------------------------------------------------------------
-void CPidScanner::sendCommand(std::string cmd)
+void CPidScanner::sendCommand(const std::string& cmd)
 {
-   m_port.writeString(cmd + "\r\n");
+   // command and EOL with one gather write, no concatenation
+   static const std::string eol("\r\n");
+   m_port.writeLine(cmd, eol);
 }
 
 // --------------------------------------------------------------
@@ -379,14 +987,14 @@ CPidScanner::ResponseType CPidScanner::readResponse(std::string &resp_recv, int
 
    rc = m_port.readStringUntil(resp_recv, delim);
 
-   if(rc == CUart::resultTimeoutExpired)
+   if(rc == CByteStream::resultTimeoutExpired)
    {
 #if DEBUGMODE
       printf("%s -- timeout\n", __FUNCTION__);
 #endif
       res = TIMEOUT; // timeout expired
    }
-   else if(rc == CUart::resultError)
+   else if(rc == CByteStream::resultError)
    {
 #if DEBUGMODE
       printf("%s -- read error\n", __FUNCTION__);
@@ -457,7 +1065,8 @@ CPidScanner::ResponseStatus CPidScanner::processResponse(std::string &msg_recv)
       return HEX_DATA;
    }
 
-   if (msg_recv.find("NODATA") != std::string::npos)
+   if (msg_recv.find("NO DATA") != std::string::npos ||
+       msg_recv.find("NODATA") != std::string::npos)
       return ERR_NO_DATA;
    if (msg_recv.rfind("UNABLETOCONNECT") != std::string::npos)
       return UNABLE_TO_CONNECT;
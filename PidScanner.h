@@ -24,7 +24,9 @@ private:
 class CPidScanner : public CRecurrent
 {
 public:
-   CPidScanner(CUart & port, int poll_interval = 1) : CRecurrent(poll_interval), m_port (port), m_initialized(false) {};
+   CPidScanner(CByteStream & port, int poll_interval = 1) : CRecurrent(poll_interval), m_port (port), m_initialized(false), m_multiPid(false), m_countSuffix(true), m_compact(true),
+      m_noDataPolls(0), m_adaptiveTiming(true), m_tuneCycles(0), m_requestTimeout(AT_TIMEOUT), m_st(0),
+      m_tunedSt(0), m_decayResponses(0) {};
    virtual ~CPidScanner() { m_port.close(); };
 
    /// Standard OBD Modes
@@ -55,8 +57,22 @@ public:
      OBDII_PID_THROTTLE_POSITION                      =  (0x11),
      OBDII_PID_FUEL_LEVEL_INPUT                       =  (0x2F),
      OBDII_PID_ECU_VOLTAGE                            =  (0x42),
+     OBDII_PID_ODOMETER                               =  (0xA6),
      };
 
+   /// Mode 01 PID descriptor, see pidInfo()
+   struct PidInfo
+   {
+       int pid;
+       size_t size;        ///< data bytes of the response
+       size_t valueSize;   ///< leading data bytes the value is taken from, big endian
+       bool isSigned;      ///< value bytes are two's complement
+       double scale;       ///< value = raw * scale + offset
+       double offset;
+       const char *units;  ///< "" - bit-encoded, the value is the raw bytes
+       const char *name;
+   };
+
      /// processResponse return values
     enum ResponseStatus
     {
@@ -101,6 +117,7 @@ public:
    * - ATZ reset to default
    * - ATE0 set echo mode off
    * - ATL0 set linefeed mode
+   * - ATS0 ATH0 ATCAF1 compact output, see setCompactOutput()
    * - set optional params from config string
    * - ATSP3 - set protocol ISO 9141-2 (???)
    * - TODO: Add ignition on/off handling (???)
@@ -111,11 +128,78 @@ public:
    int Init();
 
    /**
-   * Polls all PIDs with interval "poll_interval"
+   * Polls all PIDs with interval "poll_interval".
+   * On CAN the PIDs are requested together, see pollPids(), otherwise
+   * one by one.
    * \return 0 - OK, otherwise - error
    */
    int Poll();
 
+   /**
+   * Use multi-PID requests in Poll(). Set by Init() when the vehicle
+   * protocol is CAN, cleared when the adapter or the ECU rejects such a
+   * request, or when NO_DATA_POLLS polls in a row got only NO DATA.
+   */
+   void setMultiPid(bool on) { m_multiPid = on; };
+
+   /// \return true if Poll() uses multi-PID requests
+   bool isMultiPid() const { return m_multiPid; };
+
+   /**
+   * Append the expected number of responses to OBD requests, e.g. "01 0D1",
+   * so the adapter prints the prompt as soon as they arrived instead of
+   * waiting for its timeout. The number is learned per request: Init()
+   * sends each request once without it and counts the ECUs that answer.
+   * On by default, cleared when the adapter rejects the suffix.
+   */
+   void setCountSuffix(bool on) { m_countSuffix = on; };
+
+   /// \return true if OBD requests carry the expected number of responses
+   bool isCountSuffix() const { return m_countSuffix; };
+
+   /**
+   * Responses without spaces between the bytes (ATS0), e.g. "410C1AF8"
+   * instead of "41 0C 1A F8 ", about a third fewer bytes on the serial
+   * link; requests are sent without spaces anyway. Set by Init() along
+   * with headers off and CAN formatting on. On by default, cleared when
+   * the adapter rejects ATS0 (before v1.3); responses are decoded either
+   * way.
+   */
+   void setCompactOutput(bool on);
+
+   /// \return true if the adapter prints responses without spaces
+   bool isCompactOutput() const { return m_compact; };
+
+   /**
+   * Tune the adapter timing to the ECUs. During the first TUNE_CYCLES
+   * cycles after Init() Poll() measures the response times of requests
+   * with the count suffix, then sets the adapter timeout (ATST) to twice
+   * the slowest of them, and adaptive timing to ATAT2 if they are steady.
+   * That shortens the requests the adapter has to time out: PIDs nobody
+   * answers and multi-frame responses. A known request missed afterwards
+   * doubles the timeout and is sent again, once; after DECAY_RESPONSES
+   * responses the timeout is halved again, down to the tuned value.
+   * On by default; switching it off restores the adapter defaults.
+   */
+   void setAdaptiveTiming(bool on);
+
+   /// \return true if the adapter timing is tuned by Poll()
+   bool isAdaptiveTiming() const { return m_adaptiveTiming; };
+
+   /// \return host timeout of OBD requests, msec
+   int getRequestTimeout() const { return m_requestTimeout; };
+
+   /// \return adapter timeout (ATST), msec, 0 - adapter default
+   int getAdapterTimeout() const { return m_st * ST_UNIT_MS; };
+
+   /**
+   * \param
+   * [in] pid - Mode 01 PID
+   * \return number of ECUs that answered the single request of the PID,
+   * 0 if not learned or not used (multi-frame responses)
+   */
+   int getExpectedResponses(int pid) const;
+
    /**
    * Get last polled speed.
    * \param 
@@ -149,7 +233,8 @@ public:
    float getThrottle(bool & present);
 
    /**
-   * Get last polled odometer data.
+   * Get last polled odometer data, km. PID A6 is not polled by Poll(),
+   * ECUs before model year 2019 seldom support it, see pollValue().
    * \param 
    * [out] present - true if PID present, otherwise false
    * \return rpm - returned pid value 
@@ -165,40 +250,62 @@ public:
    float getVoltage(bool & present);
 
    /**
-   * Polls car speed.
-   * \return true if PID received, otherwise false
+   * Get the last polled value of a Mode 01 PID, see pidInfo() for its units
+   * \param
+   * [in] pid - Mode 01 PID
+   * [out] present - true if PID present, otherwise false
+   * \return value, raw bytes for bit-encoded PIDs
    */
-   bool pollSpeed();
+   double getValue(int pid, bool & present) const;
 
    /**
-   * Polls RPM.
-   * \return true if PID received, otherwise false
+   * Descriptor of a Mode 01 PID: the SAE J1979 set 00-C4, one table lookup
+   * \param
+   * [in] pid - Mode 01 PID
+   * \return descriptor, NULL if the PID is not known
    */
-   bool pollRpm();
+   static const PidInfo * pidInfo(int pid);
 
    /**
-   * Polls fuel level.
-   * \return true if PID received, otherwise false
+   * Age of the last polled value of a PID: time since its response was
+   * received, not since it was decoded
+   * \param
+   * [in] pid - Mode 01 PID
+   * \return age, very large if the PID was never received
    */
-   bool pollFuel();
+   CByteStream::Clock::duration getAge(OBD_Pid pid) const;
 
    /**
-   * Polls throttle position.
-   * \return true if PID received, otherwise false
+   * Age of the latest data: time since the newest PID response was received
+   * \return age, very large if nothing was received yet
    */
-   bool pollThrottle();
+   CByteStream::Clock::duration getDataAge() const;
 
    /**
-   * Polls odometer data.
+   * Polls a Mode 01 PID and decodes its value as pidInfo() describes,
+   * e.g. pollValue(OBDII_PID_VEHICLE_SPEED).
+   * \param
+   * [in] pid - Mode 01 PID with a descriptor
    * \return true if PID received, otherwise false
    */
-   bool pollOdometer();
+   bool pollValue(int pid);
 
    /**
-   * Polls voltage on ECU.
-   * \return true if PID received, otherwise false
+   * Polls several Mode 01 PIDs with multi-PID requests, e.g. "01 0C 0D 11".
+   * ELM327 v1.3+ accepts up to MAX_PIDS_PER_REQUEST PIDs per request on
+   * CAN; longer lists are split. With the count suffix on, see
+   * setCountSuffix(), the PIDs are grouped so that each response fits a
+   * single CAN frame. Values are stored as by pollValue(), PIDs the ECU
+   * does not answer are not present. Errors other than those of the -1
+   * return, e.g. a timeout or BUS BUSY, only lose the PIDs of the failed
+   * request.
+   * \param
+   * [in] pids - PIDs, with known data size
+   * [in] count - number of PIDs
+   * \return number of PIDs received, -1 if the adapter or the ECU rejects
+   * multi-PID requests or they got only NO DATA NO_DATA_POLLS times in a row
    */
-   bool pollVoltage();
+   int pollPids(const int *pids, size_t count);
 
    /**
    * Send string of "mode" + "pid".
@@ -210,6 +317,27 @@ public:
    * \return true if PID received, otherwise false
    */
    bool pollPid(int mode, int pid, std::string & pid_val);
+
+   /**
+   * Send string of "mode" + "pid".
+   * \param
+   * [in] mode -
+   * [in] pid -
+   * [out] val - data bytes as big endian number, e.g. (A*256)+B, up to 4 bytes
+   * \return true if PID received, otherwise false
+   */
+   bool pollPid(int mode, int pid, boost::uint32_t & val);
+
+   /**
+   * Send string of "mode" + "pid", decode the data bytes
+   * \param
+   * [in] mode -
+   * [in] pid -
+   * [out] data - data bytes, mode and PID bytes removed
+   * [in] capacity - data size
+   * \return number of data bytes, 0 if PID not received
+   */
+   size_t pollPid(int mode, int pid, unsigned char *data, size_t capacity);
    
    /**
     * Get available at the moment PIDs
@@ -222,17 +350,106 @@ public:
 
 private:
 
-    typedef struct {
-        float value;
+    /// Last value of a PID
+    struct pid_elem
+    {
+        pid_elem() : value(0), present(false) {};
+        double value;
         bool present;
-    } pid_elem;
+        CByteStream::Clock::time_point received; // arrival of the response
+    };
+
+    /// Values by PID
+    pid_elem m_values[0x100];
+
+    /// ELM327 limit of multi-PID requests, data bytes of a single CAN frame response
+    enum { MAX_PIDS_PER_REQUEST = 6, SINGLE_FRAME_DATA = 6 };
 
-    pid_elem m_speed;
-    pid_elem m_rpm;
-    pid_elem m_fuel;
-    pid_elem m_throttle;
-    pid_elem m_odometer;
-    pid_elem m_voltage;
+    /// Multi-PID fallback: service ID of a negative response, polls with NO DATA only
+    enum { NEGATIVE_RESPONSE = 0x7F, NO_DATA_POLLS = 3 };
+
+   /**
+   * Decode and store a received Mode 01 value as pidInfo() describes
+   * \param
+   * [in] pid - PID
+   * [in] data - data bytes, PID byte removed
+   * [in] size - number of data bytes
+   * \return false if the PID is not known or the data too short
+   */
+   bool storePid(int pid, const unsigned char *data, size_t size);
+
+   /**
+   * Decode a Mode 01 response to data bytes in a single pass, with or
+   * without spaces. Handles single line and multi-frame (ISO 15765-2)
+   * responses; of several ECUs, only the first answer is kept.
+   * \param
+   * [in] resp - response text
+   * [out] data - data bytes, mode byte first
+   * [in] capacity - data size
+   * \return number of data bytes
+   */
+   static size_t decodeResponse(const std::string & resp, unsigned char *data, size_t capacity);
+
+   /**
+   * \return value of a hex digit, -1 if c is not one
+   */
+   static int hexNibble(char c);
+
+   /**
+   * Send an OBD request with the expected number of responses, learn it
+   * from the response if not known yet
+   * \param
+   * [in] cmd - request without count
+   * [out] resp_str - response
+   * [in] retry - send a known request again after NO DATA, see backOff()
+   * \return ResponseStatus
+   */
+   ResponseStatus sendRequest(const std::string & cmd, std::string & resp_str, bool retry = true);
+
+   /**
+   * Take a response time of a request with the count suffix into account
+   * \param
+   * [in] latency - time from sending the request to the prompt
+   */
+   void sampleLatency(CByteStream::Clock::duration latency);
+
+   /**
+   * Program the adapter timing from the sampled response times, see
+   * setAdaptiveTiming()
+   */
+   void applyTiming();
+
+   /**
+   * Set the adapter timeout and the host timeout that goes with it
+   * \param
+   * [in] st - ATST value, ST_UNIT_MS units
+   * \return true if the adapter accepted it
+   */
+   bool setAdapterTimeout(int st);
+
+   /**
+   * Double the adapter timeout after a missed response, stop tuning
+   * \return true if the timeout was raised
+   */
+   bool backOff();
+
+   /**
+   * Count a response, halve a backed off adapter timeout after
+   * DECAY_RESPONSES of them, down to the tuned one
+   */
+   void restoreTiming();
+
+   /**
+   * Count the ECU responses in an OBD response, as the adapter counts
+   * them for the count suffix
+   * \return number of responses, 0 if there are multi-frame responses
+   */
+   static int countResponses(const std::string & resp);
+
+   /**
+   * \return true if the response to ATDPN names a CAN protocol
+   */
+   static bool isCanProtocol(const std::string & resp);
 
   /**
    * Send string and expect answer string with timeout.
@@ -261,7 +478,7 @@ private:
    * \param 
    * AT command to send
    */
-   void sendCommand(std::string cmd);
+   void sendCommand(const std::string& cmd);
 
    /**
    * Read response from ELM device
@@ -286,13 +503,65 @@ private:
         AT_TIMEOUT           = 500,
         ECU_TIMEOUT          = 5000
     };
+
+    /// Adaptive timing
+    enum
+    {
+        TUNE_CYCLES    = 3,     ///< Poll() cycles sampled before tuning
+        ST_UNIT_MS     = 4,     ///< ATST unit, msec
+        ST_DEFAULT     = 0x32,  ///< ATST after reset
+        ST_MAX         = 0xFF,
+        TIMING_MARGIN  = 2,     ///< ATST over the slowest response
+        HOST_MARGIN_MS = 100,   ///< host timeout over twice ATST
+        DECAY_RESPONSES = 16    ///< responses before a backed off ATST is halved
+    };
    
-   /// UART port object
-   CUart & m_port;
+   /// port object: UART or other byte stream
+   CByteStream & m_port;
 
    /// Init flag
    bool m_initialized;
 
+   /// Poll() uses multi-PID requests
+   bool m_multiPid;
+
+   /// OBD requests carry the expected number of responses
+   bool m_countSuffix;
+
+   /// Responses without spaces, ATS0
+   bool m_compact;
+
+   /// pollPids() calls in a row answered with NO DATA only
+   int m_noDataPolls;
+
+   /// Learned number of responses by request, 0 - no count suffix
+   std::map<std::string, int> m_responses;
+
+   /// Poll() tunes the adapter timing
+   bool m_adaptiveTiming;
+
+   /// Poll() cycles left to sample before tuning, 0 - not sampling
+   int m_tuneCycles;
+
+   /// Response times of requests with the count suffix
+   CByteStream::Clock::duration m_minLatency;
+   CByteStream::Clock::duration m_maxLatency;
+
+   /// Host timeout of OBD requests, msec
+   int m_requestTimeout;
+
+   /// Programmed ATST value, 0 - adapter default
+   int m_st;
+
+   /// ATST value set by applyTiming(), 0 - not tuned
+   int m_tunedSt;
+
+   /// Responses since the adapter timeout was last changed
+   int m_decayResponses;
+
+   /// Arrival time of the last PID response, see pollPid()
+   CByteStream::Clock::time_point m_received;
+
 };
 
 #endif // __CPIDSCANNER_H__
@@ -0,0 +1,209 @@
+/// Bulk NMEA import benchmark.
+/// Imports a recorded log, or a generated 10 Hz multi-sentence stream
+/// written to a temporary file, with CNmeaImporter on 1 to N threads,
+/// reports MB/s, sentences/s and the speedup over one thread, and checks
+/// that every run yields the same fixes as one CGps parsing the whole log
+/// in order.
+
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unistd.h>
+
+#include "CNmeaImporter.h"
+
+// --------------------------------------------
+// Append "$body*hh\r\n"
+static void addSentence(std::string & out, const char *body)
+{
+    unsigned char crc = 0;
+    for(const char *p = body; *p; p++)
+    {
+        crc ^= static_cast<unsigned char>(*p);
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf), "$%s*%02X\r\n", body, crc);
+    out += buf;
+}
+
+// Generate epochs of a 10 Hz receiver moving north-east. Every fourth
+// block of 1000 epochs is dead reckoned without satellites: the receiver
+// leaves HDOP and the GSA DOP fields empty.
+static std::string makeLog(size_t epochs)
+{
+    std::string out;
+    char body[128];
+    for(size_t k = 0; k < epochs; k++)
+    {
+        double lat_min = 18.27292 + (k % 100000) * 0.00011, lon_min = 4.72176 + (k % 100000) * 0.00017;
+        int sec = (k / 10) % 60, csec = (k % 10) * 10, min = (k / 600) % 60;
+        bool fix = (k / 1000) % 4 != 3;
+        snprintf(body, sizeof(body), "GPRMC,21%02d%02d.%02d,%c,56%08.5f,N,044%08.5f,E,12.5,45.0,010120,,",
+                 min, sec, csec, fix ? 'A' : 'V', lat_min, lon_min);
+        addSentence(out, body);
+        if(fix)
+        {
+            snprintf(body, sizeof(body), "GPGGA,21%02d%02d.%02d,56%08.5f,N,044%08.5f,E,1,07,1.21,%.1f,M,6.2,M,,",
+                     min, sec, csec, lat_min, lon_min, 250.0 + (k % 50) * 0.1);
+            addSentence(out, body);
+            addSentence(out, "GPGSA,A,3,04,05,09,12,24,25,29,,,,,,2.5,1.21,2.2");
+        }
+        else
+        {
+            snprintf(body, sizeof(body), "GPGGA,21%02d%02d.%02d,56%08.5f,N,044%08.5f,E,0,00,,,M,,M,,",
+                     min, sec, csec, lat_min, lon_min);
+            addSentence(out, body);
+            addSentence(out, "GPGSA,A,1,,,,,,,,,,,,,,,");
+        }
+        addSentence(out, "GPGSV,3,1,11,04,40,083,46,05,14,243,39,09,45,294,44,12,61,053,46");
+        addSentence(out, "GPGSV,3,2,11,24,08,178,37,25,41,140,44,29,33,315,40,02,03,101,");
+        addSentence(out, "GPGSV,3,3,11,10,12,344,,21,04,012,,26,00,225,");
+        snprintf(body, sizeof(body), "GPGLL,56%08.5f,N,044%08.5f,E,21%02d%02d.%02d,A",
+                 lat_min, lon_min, min, sec, csec);
+        addSentence(out, body);
+        addSentence(out, "GPVTG,45.0,T,,M,12.5,N,23.2,K,A");
+    }
+    return out;
+}
+
+// --------------------------------------------
+// Field by field comparison, the struct has padding. satellitesInView is
+// left out, the importer only totals the talkers seen within a chunk.
+static bool sameFix(const CGpsFix & a, const CGpsFix & b)
+{
+    return a.latitude == b.latitude && a.longitude == b.longitude && a.altitude == b.altitude &&
+           a.speed == b.speed && a.course == b.course && a.hdop == b.hdop && a.pdop == b.pdop &&
+           a.vdop == b.vdop && a.latError == b.latError && a.lonError == b.lonError &&
+           a.altError == b.altError && a.time == b.time && a.year == b.year && a.month == b.month &&
+           a.day == b.day && a.quality == b.quality && a.satellites == b.satellites &&
+           a.mode == b.mode && a.valid == b.valid && a.flags == b.flags;
+}
+
+// --------------------------------------------
+// Parse the whole log in order with one CGps, the reference result
+static void parseSequential(const std::string & file_name, std::vector<CGpsFix> & fixes)
+{
+    boost::iostreams::mapped_file_source file(file_name);
+    CGps gps;
+    CByteStream::Clock::time_point received = CByteStream::Clock::now();
+    const char *end = file.data() + file.size();
+    fixes.clear();
+    for(const char *line = file.data(); line < end; )
+    {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *line_end = eol ? eol : end;
+        if(line_end - line > 1 && gps.parseSentence(line, line_end - line, received))
+        {
+            fixes.push_back(gps.getFix());
+        }
+        line = line_end + 1;
+    }
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    size_t epochs = 200000;
+    unsigned max_threads = boost::thread::hardware_concurrency();
+    size_t chunk_size = 0;
+    const char *log_name = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "n:t:c:f:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n': epochs = strtoul(optarg, NULL, 10); break;
+        case 't': max_threads = atoi(optarg); break;
+        case 'c': chunk_size = strtoul(optarg, NULL, 10) << 10; break;
+        case 'f': log_name = optarg; break;
+        default:
+            std::cout << "Options:" << std::endl;
+            std::cout << "-f <log file>, default: generated log" << std::endl;
+            std::cout << "-n <epochs of the generated log>, 8 sentences each, default 200000" << std::endl;
+            std::cout << "-t <max threads>, default: number of cores" << std::endl;
+            std::cout << "-c <chunk size, KB>, default 1024" << std::endl;
+            return 1;
+        }
+    }
+    if(max_threads < 1)
+    {
+        max_threads = 1;
+    }
+
+    char file_name[] = "/tmp/benchImportXXXXXX";
+    if(!log_name)
+    {
+        int fd = mkstemp(file_name);
+        if(fd < 0)
+        {
+            perror("mkstemp");
+            return 1;
+        }
+        std::string text = makeLog(epochs);
+        if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size()))
+        {
+            perror("write");
+        }
+        close(fd);
+        log_name = file_name;
+    }
+
+    printf("%-8s %8s %12s %10s %10s %8s\n", "threads", "chunks", "sentences/s", "MB/s", "time, s", "speedup");
+
+    std::vector<CGpsFix> reference, fixes;
+    double base = 0;
+    int ret = 0;
+    try
+    {
+        parseSequential(log_name, reference);
+    }
+    catch(const std::exception & e)
+    {
+        std::cout << "File open error -- " << e.what() << std::endl;
+        max_threads = 0;
+        ret = 1;
+    }
+    for(unsigned threads = 1; threads <= max_threads; threads++)
+    {
+        CNmeaImporter importer(threads, chunk_size);
+        try
+        {
+            importer.import(log_name, fixes);
+        }
+        catch(const std::exception & e)
+        {
+            std::cout << "File open error -- " << e.what() << std::endl;
+            ret = 1;
+            break;
+        }
+        const CNmeaImporter::Stats & s = importer.stats();
+        if(threads == 1)
+        {
+            base = s.seconds;
+        }
+        printf("%-8u %8lu %12.0f %10.1f %10.3f %8.2f\n", threads, (unsigned long)s.chunks,
+               s.sentences / s.seconds, s.bytes / s.seconds / 1e6, s.seconds, base / s.seconds);
+
+        bool same = fixes.size() == reference.size();
+        for(size_t i = 0; same && i < fixes.size(); i++)
+        {
+            same = sameFix(fixes[i], reference[i]);
+        }
+        if(!same)
+        {
+            std::cout << "Fixes differ from the sequential parse" << std::endl;
+            ret = 2;
+            break;
+        }
+    }
+    std::cout << reference.size() << " fixes" << std::endl;
+
+    if(log_name == file_name)
+    {
+        unlink(file_name);
+    }
+    return ret;
+}
@@ -0,0 +1,376 @@
+/// NMEA parser benchmark.
+/// Feeds a generated 10 Hz multi-sentence GPS stream (RMC, GGA, GSA, GSV,
+/// GLL, VTG) through the CGps parser and through a copy of the legacy
+/// string-splitting parser, checks that both produce the same bearings and
+/// reports sentences/sec and heap allocations per sentence. The last run
+/// goes through the whole driver path, CGps::pollBearing() on a
+/// memory-mapped log. Checksum validation is timed separately, per
+/// sentence and in batch over the whole log. No hardware needed.
+
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
+
+#include "CGps.h"
+#include "CMappedFileStream.h"
+#include "CNmeaChecksum.h"
+
+// --------------------------------------------
+// Heap allocation counter
+static size_t allocations = 0;
+
+// keeps GCC from matching inlined delete against new across the program
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void * operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+BENCH_NOINLINE void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+// --------------------------------------------
+// Monotonic time, sec
+static double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// --------------------------------------------
+// CGps::parseSentence before the in-place tokenizer, for comparison
+class CLegacyGps
+{
+public:
+    CLegacyGps() : m_reads(0), m_bearing("NO_BEARINGS_YET") {};
+
+    const std::string & getBearing() const { return m_bearing; };
+
+    bool parseSentence(std::string & resp_str)
+    {
+      size_t tpos;
+      std::vector< std::string > split_vector;
+      std::string sentnc_str;
+      bool ret = false;
+
+      if( (tpos = resp_str.find("$GPRMC")) != std::string::npos)
+      {
+          sentnc_str = resp_str.substr(tpos);
+          if(checksumOK(sentnc_str))
+          {
+              boost::split( split_vector, sentnc_str, boost::is_any_of(","), boost::token_compress_off );
+              if(split_vector.size() >= 11)
+              {
+                  m_bearing = convertMMSS(split_vector[3]) + " " + split_vector[4] + ", ";
+                  m_bearing += convertMMSS(split_vector[5]) + " " + split_vector[6];
+                  m_reads = 0;
+                  ret = true;
+              }
+          }
+      }
+      else if( (tpos = resp_str.find("$GPGLL")) != std::string::npos)
+      {
+          sentnc_str = resp_str.substr(tpos);
+          if(checksumOK(sentnc_str))
+          {
+              boost::split( split_vector, sentnc_str, boost::is_any_of(","), boost::token_compress_off );
+              if(split_vector.size() >= 5)
+              {
+                  m_bearing = convertMMSS(split_vector[1]) + " " + split_vector[2] + ", ";
+                  m_bearing += convertMMSS(split_vector[3]) + " " + split_vector[4];
+                  m_reads = 0;
+                  ret = true;
+              }
+          }
+      }
+      else if( (tpos = resp_str.find("$GPGGA")) != std::string::npos)
+      {
+          sentnc_str = resp_str.substr(tpos);
+          if(checksumOK(sentnc_str))
+          {
+              boost::split( split_vector, sentnc_str, boost::is_any_of(","), boost::token_compress_off );
+              if(split_vector.size() >= 13)
+              {
+                  m_bearing = convertMMSS(split_vector[2]) + " " + split_vector[3] + ", ";
+                  m_bearing += convertMMSS(split_vector[4]) + " " + split_vector[5];
+                  m_reads = 0;
+                  ret = true;
+              }
+          }
+      }
+      return ret;
+    }
+
+    static bool checksumOK(const std::string & str)
+    {
+        size_t ppos = str.find("$");
+        size_t cpos = str.find("*");
+        uint16_t crc = 0;
+        if(ppos != std::string::npos && cpos != std::string::npos)
+        {
+            for(size_t pos = ppos+1; pos < cpos; pos++)
+            {
+                crc ^= static_cast<uint16_t>(str[pos]);
+            }
+            char* ptr_dummy;
+            uint16_t crc_expected = strtoul(str.substr(cpos + 1).c_str(), &ptr_dummy, 16);
+            return crc == crc_expected;
+        }
+        return false;
+    }
+
+private:
+    std::string convertMMSS(const std::string & inp)
+    {
+        std::string mm, ss;
+        char xxbuf[32] = "";
+        size_t ppos = inp.find(".");
+        if(ppos != std::string::npos)
+        {
+            if(ppos <= 4)
+            {
+              mm = inp.substr(0, 2);
+              ss = inp.substr(2, 2);
+            }
+            else
+            {
+              mm = inp.substr(0, 3);
+              ss = inp.substr(3, 2);
+            }
+            int xxv = 60*atof(inp.substr(ppos).c_str());
+            snprintf(xxbuf, sizeof(xxbuf), "%02d", xxv);
+        }
+        return mm + " " + ss + " " + xxbuf;
+    }
+
+    int m_reads;
+    std::string m_bearing;
+};
+
+// --------------------------------------------
+// Append "$body*hh"
+static void addSentence(std::vector<std::string> & out, const char *body)
+{
+    unsigned char crc = 0;
+    for(const char *p = body; *p; p++)
+    {
+        crc ^= static_cast<unsigned char>(*p);
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf), "$%s*%02X", body, crc);
+    out.push_back(buf);
+}
+
+// Generate epochs of a 10 Hz receiver moving north-east
+static std::vector<std::string> makeStream(size_t epochs)
+{
+    std::vector<std::string> out;
+    char body[128];
+    for(size_t k = 0; k < epochs; k++)
+    {
+        double lat_min = 18.27292 + k * 0.00011, lon_min = 4.72176 + k * 0.00017;
+        int sec = (k / 10) % 60, csec = (k % 10) * 10;
+        snprintf(body, sizeof(body), "GPRMC,2117%02d.%02d,A,56%08.5f,N,044%08.5f,E,12.5,45.0,010120,,",
+                 sec, csec, lat_min, lon_min);
+        addSentence(out, body);
+        snprintf(body, sizeof(body), "GPGGA,2117%02d.%02d,56%08.5f,N,044%08.5f,E,1,07,1.21,250.1,M,6.2,M,,",
+                 sec, csec, lat_min, lon_min);
+        addSentence(out, body);
+        addSentence(out, "GPGSA,A,3,04,05,09,12,24,25,29,,,,,,2.5,1.21,2.2");
+        addSentence(out, "GPGSV,3,1,11,04,40,083,46,05,14,243,39,09,45,294,44,12,61,053,46");
+        addSentence(out, "GPGSV,3,2,11,24,08,178,37,25,41,140,44,29,33,315,40,02,03,101,");
+        addSentence(out, "GPGSV,3,3,11,10,12,344,,21,04,012,,26,00,225,");
+        snprintf(body, sizeof(body), "GPGLL,56%08.5f,N,044%08.5f,E,2117%02d.%02d,A",
+                 lat_min, lon_min, sec, csec);
+        addSentence(out, body);
+        addSentence(out, "GPVTG,45.0,T,,M,12.5,N,23.2,K,A");
+    }
+    return out;
+}
+
+// --------------------------------------------
+// Print one result line
+static void report(const char *name, size_t sentences, double sec, size_t allocs)
+{
+    printf("%-24s %12.0f %10.3f %12.2f\n", name, sentences / sec, sec, double(allocs) / sentences);
+}
+
+// Run CGps::pollBearing() over a log, sentences/s count every line of it
+static void pollLog(const char *file_name, int passes, const char *types, const char *name)
+{
+    size_t lines = 0, allocs = 0;
+    double elapsed = 0;
+    for(int pass = 0; pass < passes; pass++)
+    {
+        CMappedFileStream file(file_name);
+        CGps driver(file);
+        driver.setSentenceFilter(types);
+        // first sentence sizes the line buffer
+        driver.pollBearing();
+        size_t a = allocations;
+        double t0 = now();
+        size_t polled = 1;
+        while(!file.eof())
+        {
+            driver.pollBearing();
+            polled++;
+        }
+        elapsed += now() - t0;
+        allocs += allocations - a;
+        lines += polled + driver.getSkippedCount();
+    }
+    report(name, lines, elapsed, allocs);
+}
+
+// Print one checksum result line
+static void reportChecksum(const char *name, size_t sentences, double sec, size_t bytes)
+{
+    printf("%-24s %12.0f %10.3f %12.1f\n", name, sentences / sec, sec, bytes / sec / 1e6);
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    size_t epochs = 20000;
+    int passes = 10;
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n': epochs = strtoul(optarg, NULL, 10); break;
+        case 'p': passes = atoi(optarg); break;
+        default:
+            std::cout << "Options:" << std::endl;
+            std::cout << "-n <epochs>, 8 sentences each, default 20000" << std::endl;
+            std::cout << "-p <passes over the stream>, default 10" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> stream = makeStream(epochs);
+    const size_t sentences = stream.size() * passes;
+
+    // both parsers must agree
+    CGps gps;
+    CLegacyGps legacy;
+    bool present;
+    for(size_t i = 0; i < stream.size(); i++)
+    {
+        if(gps.parseSentence(stream[i]) != legacy.parseSentence(stream[i]) ||
+           gps.getBearing(present) != legacy.getBearing())
+        {
+            std::cout << "Mismatch: " << stream[i] << std::endl
+                      << "  legacy: " << legacy.getBearing() << std::endl
+                      << "  new:    " << gps.getBearing(present) << std::endl;
+            return 2;
+        }
+    }
+
+    printf("%-24s %12s %10s %12s\n", "parser", "sentences/s", "time, s", "allocs/sent");
+
+    size_t allocs0 = allocations;
+    double t0 = now();
+    for(int pass = 0; pass < passes; pass++)
+    {
+        for(size_t i = 0; i < stream.size(); i++)
+        {
+            legacy.parseSentence(stream[i]);
+        }
+    }
+    report("legacy parseSentence", sentences, now() - t0, allocations - allocs0);
+
+    allocs0 = allocations;
+    t0 = now();
+    for(int pass = 0; pass < passes; pass++)
+    {
+        for(size_t i = 0; i < stream.size(); i++)
+        {
+            gps.parseSentence(stream[i]);
+        }
+    }
+    report("parseSentence", sentences, now() - t0, allocations - allocs0);
+
+    // whole driver path on a recorded log
+    char file_name[] = "/tmp/benchNmeaXXXXXX";
+    int fd = mkstemp(file_name);
+    if(fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    std::string text;
+    for(size_t i = 0; i < stream.size(); i++)
+    {
+        text += stream[i];
+        text += "\r\n";
+    }
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size()))
+    {
+        perror("write");
+    }
+    close(fd);
+
+    pollLog(file_name, passes, "", "pollBearing, mapped log");
+    // position sentences only, the rest is skipped in the mapping
+    pollLog(file_name, passes, "RMC,GGA,GLL", "  filtered RMC,GGA,GLL");
+    unlink(file_name);
+
+    // checksum validation
+    printf("\n%-24s %12s %10s %12s\n", "checksum", "sentences/s", "time, s", "MB/s");
+    size_t valid = 0;
+    t0 = now();
+    for(int pass = 0; pass < passes; pass++)
+    {
+        for(size_t i = 0; i < stream.size(); i++)
+        {
+            valid += CLegacyGps::checksumOK(stream[i]);
+        }
+    }
+    reportChecksum("legacy checksumOK", sentences, now() - t0, text.size() * passes);
+
+    t0 = now();
+    for(int pass = 0; pass < passes; pass++)
+    {
+        for(size_t i = 0; i < stream.size(); i++)
+        {
+            valid += CNmeaChecksum::validate(stream[i].data(), stream[i].size());
+        }
+    }
+    reportChecksum("CNmeaChecksum::validate", sentences, now() - t0, text.size() * passes);
+
+    size_t invalid = 0, batch_valid = 0;
+    t0 = now();
+    for(int pass = 0; pass < passes; pass++)
+    {
+        batch_valid += CNmeaChecksum::validateBatch(text.data(), text.size(), invalid);
+    }
+    reportChecksum("validateBatch", sentences, now() - t0, text.size() * passes);
+
+    if(valid != 2 * sentences || batch_valid != sentences || invalid)
+    {
+        std::cout << "Checksum mismatch" << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+TARGET := BenchNmea
+
+SRC_CXXFLAGS := -g -O2 -Wall -pipe
+TGT_LDFLAGS := -L${TARGET_DIR}
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono -lboost_iostreams
+TGT_PREREQS := 
+
+SOURCES := benchNmea.cpp ../CSerialPort.cpp
+
+SRC_INCDIRS := ..
@@ -0,0 +1,223 @@
+/// OBD poll cycle benchmark against a simulated ELM327.
+/// CPidScanner talks to CElmSimulator over a pseudo-terminal loopback.
+/// Measures the time and the bytes received of a Poll() cycle with
+/// responses with and without spaces, then with one request per PID and
+/// with multi-PID requests on a CAN vehicle, and checks the fallback to one
+/// request per PID on a legacy vehicle. Then measures the latency of each
+/// PID request with and without the expected number of responses
+/// appended, and the cycle of a vehicle without PID 42 before and after
+/// the adapter timing is tuned, then with an ECU slower than the tuned
+/// timeout. No hardware needed.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <iostream>
+#include <unistd.h>
+
+#include "CSerialPort.h"
+#include "PidScanner.h"
+#include "CElmSimulator.h"
+
+// --------------------------------------------
+// Monotonic time, sec
+static double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// --------------------------------------------
+// Benchmark parameters
+struct BenchParams
+{
+    size_t cycles;      // Poll() cycles per run
+    unsigned ecu_us;    // ECU response time
+    unsigned wait_us;   // adapter wait for more responses
+};
+
+// --------------------------------------------
+// Values of the simulator defaults decoded correctly
+static bool valuesOk(CPidScanner & scanner, bool has_voltage)
+{
+    bool speed, rpm, throttle, fuel, voltage;
+    bool ok = scanner.getSpeed(speed) == 50 && scanner.getRpm(rpm) == 1726 &&
+              fabs(scanner.getThrottle(throttle) - 64 / 2.55) < 1e-3 &&
+              fabs(scanner.getFuel(fuel) - 128 / 2.55) < 1e-3;
+    float volts = scanner.getVoltage(voltage);
+    ok = ok && (has_voltage ? voltage && fabs(volts - 12.336) < 1e-3 : !voltage);
+    return ok && speed && rpm && throttle && fuel;
+}
+
+// --------------------------------------------
+// Poll cycles in the current mode of the scanner
+static void runCycles(const char *name, CPidScanner & scanner, const CElmSimulator & elm, const BenchParams & prm,
+                      bool has_voltage = true)
+{
+    size_t requests = elm.getCounts().requests;
+    size_t bytes = elm.getCounts().bytesOut;
+    double t0 = now();
+    bool ok = true;
+    for(size_t i = 0; i < prm.cycles; i++)
+    {
+        scanner.Poll();
+        ok = ok && valuesOk(scanner, has_voltage);
+    }
+    double cycle = (now() - t0) / prm.cycles;
+    printf("%-22s %-9s %10.1f %10.2f %10.1f %8s\n", name, scanner.isMultiPid() ? "multi" : "single",
+           cycle * 1e3, (double)(elm.getCounts().requests - requests) / prm.cycles,
+           (double)(elm.getCounts().bytesOut - bytes) / prm.cycles, ok ? "ok" : "WRONG");
+}
+
+// --------------------------------------------
+// Latency of single PID requests, without and with the count suffix
+static void runLatency(CPidScanner & scanner, const BenchParams & prm)
+{
+    static const int pids[] = { 0x2F, 0x0C, 0x0D, 0x11, 0x42 };
+    printf("\n%-6s %10s %14s %14s\n", "PID", "responses", "no count ms", "count ms");
+    for(size_t i = 0; i < sizeof(pids) / sizeof(pids[0]); i++)
+    {
+        double ms[2];
+        for(int suffix = 0; suffix < 2; suffix++)
+        {
+            scanner.setCountSuffix(suffix != 0);
+            std::string pid_str;
+            double t0 = now();
+            for(size_t k = 0; k < prm.cycles; k++)
+            {
+                scanner.pollPid(CPidScanner::OBDII_MODE_SHOW_CURRENT_DATA, pids[i], pid_str);
+            }
+            ms[suffix] = (now() - t0) / prm.cycles * 1e3;
+        }
+        printf("01 %02X  %10d %14.1f %14.1f\n", pids[i], scanner.getExpectedResponses(pids[i]), ms[0], ms[1]);
+    }
+    scanner.setCountSuffix(true);
+}
+
+// --------------------------------------------
+// Open the simulated adapter and initialize the scanner, timing untuned
+static bool init(CPtyLoopback & pty, CUart & uart, CPidScanner & scanner, CElmSimulator & elm)
+{
+    scanner.setAdaptiveTiming(false);
+    pty.startResponder(elm.responder());
+    uart.open(pty.getSlaveName(), 38400);
+    uart.setTimeout(boost::posix_time::seconds(2));
+    if(scanner.Init() != 0)
+    {
+        std::cout << "Init failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    BenchParams prm;
+    prm.cycles = 10;
+    prm.ecu_us = 5000;
+    prm.wait_us = 50000;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:e:w:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n': prm.cycles = strtoul(optarg, NULL, 0); break;
+        case 'e': prm.ecu_us = strtoul(optarg, NULL, 0); break;
+        case 'w': prm.wait_us = strtoul(optarg, NULL, 0); break;
+        default:
+            std::cout << "Options:" << std::endl;
+            std::cout << "-n <poll cycles per run>, default 10" << std::endl;
+            std::cout << "-e <usec>, ECU response time, default 5000" << std::endl;
+            std::cout << "-w <usec>, adapter wait for more responses, default 50000" << std::endl;
+            return 1;
+        }
+    }
+    if(prm.cycles == 0)
+    {
+        prm.cycles = 1;
+    }
+
+    printf("cycles=%lu ECU response=%u us adapter wait=%u us (Init takes 5 s per vehicle)\n",
+           (unsigned long)prm.cycles, prm.ecu_us, prm.wait_us);
+    printf("%-22s %-9s %10s %10s %10s %8s\n", "vehicle", "requests", "cycle ms", "req/cycle", "bytes/cyc", "values");
+
+    {
+        CElmSimulator elm(CElmSimulator::PROTOCOL_CAN_11_500, prm.ecu_us, prm.wait_us);
+        CPtyLoopback pty;
+        CUart uart;
+        CPidScanner scanner(uart, 0);
+        if(!init(pty, uart, scanner, elm))
+        {
+            return 2;
+        }
+        bool detected = scanner.isMultiPid();
+        scanner.setMultiPid(false);
+        scanner.setCompactOutput(false);
+        runCycles("CAN 11/500, spaces", scanner, elm, prm);
+        scanner.setCompactOutput(true);
+        runCycles("CAN 11/500", scanner, elm, prm);
+        scanner.setMultiPid(true);
+        runCycles("CAN 11/500", scanner, elm, prm);
+        if(!detected)
+        {
+            std::cout << "CAN not detected by Init" << std::endl;
+        }
+        runLatency(scanner, prm);
+    }
+    {
+        CElmSimulator elm(CElmSimulator::PROTOCOL_ISO_9141, prm.ecu_us, prm.wait_us);
+        CPtyLoopback pty;
+        CUart uart;
+        CPidScanner scanner(uart, 0);
+        if(!init(pty, uart, scanner, elm))
+        {
+            return 2;
+        }
+        bool detected = scanner.isMultiPid();
+        // forced on, the cycles ask one by one after the NO DATA answers,
+        // after a few of them multi-PID requests are turned off
+        scanner.setMultiPid(true);
+        runCycles("ISO 9141, fallback", scanner, elm, prm);
+        if(detected)
+        {
+            std::cout << "legacy protocol taken for CAN by Init" << std::endl;
+        }
+    }
+    {
+        // a PID nobody answers costs the adapter timeout on every cycle
+        CElmSimulator elm(CElmSimulator::PROTOCOL_CAN_11_500, prm.ecu_us, prm.wait_us);
+        elm.setPid(0x42, "", 0);
+        CPtyLoopback pty;
+        CUart uart;
+        CPidScanner scanner(uart, 0);
+        if(!init(pty, uart, scanner, elm))
+        {
+            return 2;
+        }
+        printf("\n");
+        scanner.setMultiPid(false);
+        runCycles("CAN, no 42, default", scanner, elm, prm, false);
+
+        scanner.setAdaptiveTiming(true);
+        for(int i = 0; i < 10 && scanner.getAdapterTimeout() == 0; i++)
+        {
+            scanner.Poll();
+        }
+        int st_ms = scanner.getAdapterTimeout();
+        runCycles("CAN, no 42, tuned", scanner, elm, prm, false);
+
+        elm.setEcuTime(st_ms * 1500);
+        runCycles("CAN, no 42, slow ECU", scanner, elm, prm, false);
+        printf("adapter timeout: tuned %d ms, after slow ECU %d ms\n", st_ms, scanner.getAdapterTimeout());
+        if(st_ms == 0)
+        {
+            std::cout << "timing not tuned" << std::endl;
+        }
+    }
+    return 0;
+}
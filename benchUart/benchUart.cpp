@@ -0,0 +1,290 @@
+/// Serial path benchmark on a pseudo-terminal loopback.
+/// Injects NMEA-like lines into a pty at a given rate and burst pattern and
+/// measures lines/sec, bytes/sec, per-read latency and CPU use of the CUart
+/// read functions. With -l measures command/response round trip of an
+/// emulated ELM327 with and without the CUart low-latency profile.
+/// No hardware needed.
+
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "CSerialPort.h"
+#include "CPtyLoopback.h"
+
+// --------------------------------------------
+// Monotonic time, sec
+static double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// CPU time of a rusage, sec
+static double cpuTime(int who)
+{
+    struct rusage ru;
+    getrusage(who, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+// --------------------------------------------
+// Benchmarked read functions
+enum ReadMethod
+{
+    METHOD_READ,            // read(char *, size)
+    METHOD_READ_STRING,     // readString()
+    METHOD_READ_UNTIL,      // readStringUntil()
+    METHOD_READ_LINE,       // readLine()
+    METHOD_COUNT
+};
+
+static const char * METHOD_NAMES[METHOD_COUNT] = { "read", "readString", "readStringUntil", "readLine" };
+
+// --------------------------------------------
+// Benchmark parameters
+struct BenchParams
+{
+    size_t lines;       // lines to inject
+    size_t rate;        // bytes/sec, 0 - unlimited
+    size_t burst;       // bytes per burst, 0 - one line
+    size_t chunk;       // read size of read()/readString()
+    bool reader;        // use CUart background reader
+    bool roundtrip;     // measure round trip instead of read functions
+    unsigned delay_us;  // emulated device processing time
+};
+
+// --------------------------------------------
+// Run one read function over the injected stream and print results
+static void runBench(ReadMethod method, const BenchParams & prm, const std::string & line)
+{
+    CPtyLoopback pty;
+    CUart uart;
+    uart.open(pty.getSlaveName(), 115200);
+    uart.setTimeout(boost::posix_time::milliseconds(500));
+    if(prm.reader)
+    {
+        uart.startReader();
+    }
+
+    size_t total = prm.lines * line.size();
+    if(method == METHOD_READ || method == METHOD_READ_STRING)
+    {
+        // fixed-size reads: whole chunks only, readString fills its capacity
+        total -= total % prm.chunk;
+    }
+    std::vector<double> latency;
+    latency.reserve(prm.lines + 1);
+    std::vector<char> buf(prm.chunk);
+    std::string str;
+    str.reserve(prm.chunk);
+    size_t bytes = 0, lines = 0, timeouts = 0;
+
+    double cpu_thread0 = cpuTime(RUSAGE_THREAD), cpu_proc0 = cpuTime(RUSAGE_SELF);
+    double t0 = now();
+    pty.startInjection(line, prm.lines * line.size(), prm.rate, prm.burst);
+
+    while(bytes < total)
+    {
+        double t = now();
+        int rc = CUart::resultError;
+        size_t n = 0;
+        switch(method)
+        {
+        case METHOD_READ:
+            rc = uart.read(&buf[0], prm.chunk);
+            n = (rc == CUart::resultSuccess) ? prm.chunk : 0;
+            break;
+        case METHOD_READ_STRING:
+            rc = uart.readString(str);
+            n = (rc == CUart::resultSuccess) ? str.size() : 0;
+            break;
+        case METHOD_READ_UNTIL:
+            str.clear();
+            rc = uart.readStringUntil(str, "\r\n");
+            n = (rc == CUart::resultSuccess) ? line.size() : 0;
+            break;
+        case METHOD_READ_LINE:
+            rc = uart.readLine(&buf[0], buf.size(), n, "\r\n");
+            n = (rc == CUart::resultSuccess) ? line.size() : 0;
+            break;
+        default:
+            break;
+        }
+        latency.push_back(now() - t);
+        if(rc == CUart::resultTimeoutExpired)
+        {
+            // stop when the injector is done and nothing more arrives
+            if(++timeouts > 2)
+            {
+                break;
+            }
+            continue;
+        }
+        if(rc != CUart::resultSuccess)
+        {
+            std::cout << METHOD_NAMES[method] << ": read error" << std::endl;
+            break;
+        }
+        bytes += n;
+    }
+    double wall = now() - t0;
+    double cpu_thread = cpuTime(RUSAGE_THREAD) - cpu_thread0;
+    double cpu_proc = cpuTime(RUSAGE_SELF) - cpu_proc0;
+    pty.stopInjection();
+    lines = bytes / line.size();
+
+    std::sort(latency.begin(), latency.end());
+    double sum = 0;
+    for(size_t i = 0; i < latency.size(); i++)
+    {
+        sum += latency[i];
+    }
+    size_t nlat = latency.size() ? latency.size() : 1;
+    printf("%-16s %10.0f %10.0f %9.1f %9.1f %9.1f %9.1f %8.1f %8.1f %s\n",
+           METHOD_NAMES[method],
+           lines / wall, bytes / wall,
+           sum / nlat * 1e6,
+           latency.empty() ? 0 : latency[latency.size() / 2] * 1e6,
+           latency.empty() ? 0 : latency[latency.size() * 99 / 100] * 1e6,
+           latency.empty() ? 0 : latency.back() * 1e6,
+           cpu_thread / wall * 100, cpu_proc / wall * 100,
+           bytes < total ? "(incomplete)" : "");
+
+    // CUart's own counters for the same run
+    CUartStats st;
+    uart.getStats(st);
+    printf("%-16s reads=%llu lines=%llu in=%llu timeouts=%llu errors=%llu rx-hw=%llu read-p99<=%llu us\n",
+           "  stats", (unsigned long long)st.reads, (unsigned long long)st.lines,
+           (unsigned long long)st.bytesIn, (unsigned long long)st.timeouts,
+           (unsigned long long)st.errors, (unsigned long long)st.rxHighWater,
+           (unsigned long long)st.readLatency.percentileUs(99));
+}
+
+// --------------------------------------------
+// Emulated ELM327: answers every request with a vehicle speed response
+static std::string elmReply(const std::string & request)
+{
+    return "41 0D 32\r\r>";
+}
+
+// --------------------------------------------
+// Measure request/response round trip, as CPidScanner does per PID
+static void runRoundTrip(bool low_latency, const BenchParams & prm)
+{
+    CPtyLoopback pty;
+    pty.startResponder(&elmReply, '\r', prm.delay_us);
+    CUart uart;
+    uart.setLowLatency(low_latency);
+    uart.open(pty.getSlaveName(), 38400);
+    uart.setTimeout(boost::posix_time::milliseconds(500));
+
+    std::vector<double> rtt;
+    rtt.reserve(prm.lines);
+    std::string resp;
+    size_t errors = 0;
+    double cpu0 = cpuTime(RUSAGE_THREAD);
+    double t0 = now();
+    for(size_t i = 0; i < prm.lines; i++)
+    {
+        double t = now();
+        uart.writeString("010D\r");
+        resp.clear();
+        if(uart.readStringUntil(resp, ">") != CUart::resultSuccess)
+        {
+            errors++;
+            continue;
+        }
+        rtt.push_back(now() - t);
+    }
+    double wall = now() - t0;
+    double cpu = cpuTime(RUSAGE_THREAD) - cpu0;
+
+    std::sort(rtt.begin(), rtt.end());
+    double sum = 0;
+    for(size_t i = 0; i < rtt.size(); i++)
+    {
+        sum += rtt[i];
+    }
+    size_t nrtt = rtt.size() ? rtt.size() : 1;
+    printf("%-12s %-10s %9.1f %9.1f %9.1f %9.1f %8.1f %7lu\n",
+           low_latency ? "on" : "off",
+           uart.isLowLatency() ? "set" : "n/a",
+           sum / nrtt * 1e6,
+           rtt.empty() ? 0 : rtt[rtt.size() / 2] * 1e6,
+           rtt.empty() ? 0 : rtt[rtt.size() * 99 / 100] * 1e6,
+           rtt.empty() ? 0 : rtt.back() * 1e6,
+           cpu / wall * 100, (unsigned long)errors);
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    BenchParams prm;
+    prm.lines = 100000;
+    prm.rate = 0;
+    prm.burst = 0;
+    prm.chunk = 256;
+    prm.reader = false;
+    prm.roundtrip = false;
+    prm.delay_us = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:r:b:c:Rld:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n': prm.lines = strtoul(optarg, NULL, 0); break;
+        case 'r': prm.rate = strtoul(optarg, NULL, 0); break;
+        case 'b': prm.burst = strtoul(optarg, NULL, 0); break;
+        case 'c': prm.chunk = strtoul(optarg, NULL, 0); break;
+        case 'R': prm.reader = true; break;
+        case 'l': prm.roundtrip = true; break;
+        case 'd': prm.delay_us = strtoul(optarg, NULL, 0); break;
+        default:
+            std::cout << "Options:" << std::endl;
+            std::cout << "-n <lines>, default 100000" << std::endl;
+            std::cout << "-r <rate bytes/sec>, default unlimited (11520 ~ 115200 baud)" << std::endl;
+            std::cout << "-b <burst bytes>, default one line" << std::endl;
+            std::cout << "-c <read size of read/readString>, default 256" << std::endl;
+            std::cout << "-R use background reader" << std::endl;
+            std::cout << "-l measure round trip with low-latency profile off/on (-n requests)" << std::endl;
+            std::cout << "-d <usec>, emulated device processing time for -l" << std::endl;
+            return 1;
+        }
+    }
+
+    if(prm.roundtrip)
+    {
+        printf("requests=%lu device delay=%u us\n", (unsigned long)prm.lines, prm.delay_us);
+        printf("%-12s %-10s %9s %9s %9s %9s %8s %7s\n",
+               "low-latency", "flag", "avg us", "p50 us", "p99 us", "max us", "cpu %", "errors");
+        runRoundTrip(false, prm);
+        runRoundTrip(true, prm);
+        return 0;
+    }
+
+    const std::string line = "$GPGGA,211733.00,5618.27292,N,04404.72176,E,1,07,1.21,250.1,M,6.2,M,,*69\r\n";
+    if(prm.burst == 0)
+    {
+        prm.burst = line.size();
+    }
+
+    printf("lines=%lu rate=%lu B/s burst=%lu B chunk=%lu reader=%s\n",
+           (unsigned long)prm.lines, (unsigned long)prm.rate, (unsigned long)prm.burst,
+           (unsigned long)prm.chunk, prm.reader ? "on" : "off");
+    printf("%-16s %10s %10s %9s %9s %9s %9s %8s %8s\n",
+           "function", "lines/s", "bytes/s", "avg us", "p50 us", "p99 us", "max us", "cpu %", "proc %");
+    for(int m = 0; m < METHOD_COUNT; m++)
+    {
+        runBench(static_cast<ReadMethod>(m), prm, line);
+    }
+    return 0;
+}
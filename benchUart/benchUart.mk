@@ -0,0 +1,10 @@
+TARGET := BenchUart
+
+SRC_CXXFLAGS := -g -O2 -Wall -pipe
+TGT_LDFLAGS := -L${TARGET_DIR}
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono -lutil
+TGT_PREREQS := 
+
+SOURCES := benchUart.cpp ../CSerialPort.cpp
+
+SRC_INCDIRS := ..
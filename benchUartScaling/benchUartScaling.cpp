@@ -0,0 +1,164 @@
+/// Scaling benchmark of many serial ports served by one shared io_service.
+/// Serial devices are emulated with pseudo-terminal pairs, so no hardware
+/// is needed: feeder threads write NMEA-like lines to the master sides as
+/// fast as the ptys accept them, CUart objects on the slave sides read
+/// them asynchronously.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pty.h>
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "CSerialPort.h"
+
+// --------------------------------------------
+// One emulated device: pty master (feeder side) + CUart (reader side)
+class CBenchPort
+{
+public:
+    CBenchPort(boost::asio::io_service & ios) : m_uart(ios), m_master(-1), m_lines(0), m_running(false) {};
+    ~CBenchPort() { m_uart.close(); if(m_master >= 0) ::close(m_master); };
+
+    /// Open pty pair and the CUart on its slave side
+    bool open()
+    {
+        int slave;
+        char name[64];
+        if(openpty(&m_master, &slave, name, NULL, NULL) != 0)
+        {
+            perror("openpty");
+            return false;
+        }
+        ::close(slave); // CUart opens the slave by name
+        fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+        m_uart.open(name, 115200);
+        return true;
+    };
+
+    /// Start asynchronous read loop
+    void start()
+    {
+        m_running = true;
+        m_uart.asyncReadStringUntil("\r\n", boost::bind(&CBenchPort::onLine, this, _1, _2));
+    };
+
+    void stop() { m_running = false; };
+
+    int master() const { return m_master; };
+    unsigned long lines() const { return m_lines; };
+
+private:
+    void onLine(int rc, const std::string & line)
+    {
+        if(rc == CUart::resultSuccess)
+        {
+            m_lines++;
+        }
+        if(m_running)
+        {
+            m_uart.asyncReadStringUntil("\r\n", boost::bind(&CBenchPort::onLine, this, _1, _2));
+        }
+    };
+
+    CUart m_uart;
+    int m_master;
+    unsigned long m_lines;
+    boost::atomic<bool> m_running;
+};
+
+// --------------------------------------------
+// Feeder: writes blocks of lines to a subset of pty masters
+static void feed(const std::vector<int> & masters, const std::string & block, boost::atomic<bool> & running)
+{
+    while(running)
+    {
+        bool written = false;
+        for(size_t i = 0; i < masters.size(); i++)
+        {
+            if(::write(masters[i], block.data(), block.size()) > 0)
+            {
+                written = true;
+            }
+        }
+        if(!written)
+        {
+            usleep(100);
+        }
+    }
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    std::cout << "Parameters: [max ports] [pool threads] [seconds per step]" << std::endl;
+
+    const size_t MAX_PORTS = (argc > 1) ? atoi(argv[1]) : 64;
+    const size_t THREADS = (argc > 2) ? atoi(argv[2]) : std::max(1u, boost::thread::hardware_concurrency());
+    const int SECONDS = (argc > 3) ? atoi(argv[3]) : 2;
+    const size_t FEEDERS = std::max(1u, boost::thread::hardware_concurrency() / 2);
+
+    // Block of 16 lines, written to a master in one call
+    const std::string line = "$GPGGA,211733.00,5618.27292,N,04404.72176,E,1,07,1.21,250.1,M,6.2,M,,*69\r\n";
+    std::string block;
+    for(int i = 0; i < 16; i++)
+    {
+        block += line;
+    }
+
+    printf("%8s %8s %14s %14s %14s\n", "ports", "threads", "lines/s", "lines/s/port", "MB/s");
+    for(size_t nports = 1; nports <= MAX_PORTS; nports *= 2)
+    {
+        CUartService service;
+        boost::ptr_vector<CBenchPort> ports;
+        std::vector< std::vector<int> > masters(std::min(FEEDERS, nports));
+
+        for(size_t i = 0; i < nports; i++)
+        {
+            ports.push_back(new CBenchPort(service.getIoService()));
+            if(!ports.back().open())
+            {
+                return 2;
+            }
+            masters[i % masters.size()].push_back(ports.back().master());
+            ports.back().start();
+        }
+
+        boost::atomic<bool> running(true);
+        boost::thread_group feeders;
+        for(size_t i = 0; i < masters.size(); i++)
+        {
+            feeders.create_thread(boost::bind(&feed, boost::cref(masters[i]), boost::cref(block), boost::ref(running)));
+        }
+
+        service.start(THREADS);
+        boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+        sleep(SECONDS);
+        for(size_t i = 0; i < nports; i++)
+        {
+            ports[i].stop();
+        }
+        service.stop();
+        boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+        running = false;
+        feeders.join_all();
+
+        unsigned long total = 0;
+        for(size_t i = 0; i < nports; i++)
+        {
+            total += ports[i].lines();
+        }
+        double secs = (t1 - t0).total_microseconds() * 1e-6;
+        double rate = total / secs;
+        printf("%8lu %8lu %14.0f %14.0f %14.2f\n", (unsigned long)nports, (unsigned long)THREADS,
+               rate, rate / nports, rate * line.size() / 1e6);
+    }
+    return 0;
+}
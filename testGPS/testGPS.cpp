@@ -4,7 +4,46 @@
 #include <string>
 #include <iostream>
 
+#include <boost/chrono.hpp>
+
 #include "CGps.h"
+#include "CMappedFileStream.h"
+#include "CFdStream.h"
+#include "CSocketStream.h"
+#include "CNmeaImporter.h"
+
+// --------------------------------------------
+// Feed recorded or relayed NMEA data through CGps until the end of stream,
+// then print parser throughput
+template <class Stream>
+int replay(Stream & stream, const char *types)
+{
+    CGps GPS(stream);
+    GPS.setSentenceDelimiter("\n");
+    GPS.setSentenceFilter(types ? types : "");
+    stream.setTimeout(boost::posix_time::seconds(1));
+
+    std::string pos_val;
+    bool data_present;
+    unsigned long sentences = 0;
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    while(stream.isOpen() && !stream.eof())
+    {
+        if(GPS.pollBearing())
+        {
+            sentences++;
+            pos_val = GPS.getBearing(data_present);
+            std::cout << "Position = " << pos_val << (data_present ? "" : " - error: old data") << std::endl;
+        }
+    }
+
+    double sec = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+    std::cerr << sentences << " sentences in " << sec << " s, "
+              << (sec > 0 ? sentences / sec : 0) << " sentences/s, "
+              << GPS.getSkippedCount() << " lines filtered out" << std::endl;
+    return 0;
+}
 
 // --------------------------------------------
 // Main program
@@ -15,59 +54,80 @@ int main(int argc, char* argv[])
     boost::system::error_code errcode;
 
     std::cout << "Options:" << std::endl;
-    std::cout << "-f [file name], default file: gps.log" << std::endl;
+    std::cout << "-f [file name] [types], default file: gps.log" << std::endl;
+    std::cout << "-p [fifo name | -] [types], default: stdin" << std::endl;
+    std::cout << "-s <host:port | unix socket path> [types]" << std::endl;
+    std::cout << "  types: sentence types to read, e.g. RMC,GGA, default: all" << std::endl;
+    std::cout << "-i [file name] [threads], bulk import, default: gps.log, one thread per core" << std::endl;
     std::cout << "or" << std::endl;
-    std::cout << "<tty name> <speed>, default: /dev/ttySC0 38400" << std::endl;
+    std::cout << "<tty name> <speed> [drain budget, msec], default: /dev/ttySC0 38400 0" << std::endl;
 
-    bool file_mode = false;
-    if(argc > 1 && argv[1] && strcmp(argv[1], "-f") == 0)
-    {
-        file_mode = true;
-    }
+    const char *mode = (argc > 1) ? argv[1] : "";
+    const char *name = (argc > 2) ? argv[2] : NULL;
+    const char *types = (argc > 3) ? argv[3] : NULL;
 
-    if(file_mode)
+    if(strcmp(mode, "-f") == 0)
     {
-        const char *file_name = argv[2] ? argv[2] : "gps.log";
-        FILE *fp = fopen(file_name, "r");
-        if(!fp)
+        CMappedFileStream file;
+        try
         {
-            perror("fopen");
+            file.open(name ? name : "gps.log");
+        }
+        catch(const std::exception & e)
+        {
+            std::cout << "File open error -- " << e.what() << std::endl;
             return 1;
         }
-
-        CGps GPS;
-
-        std::string pos_val;
-        bool data_present;
-        
-        for(int k = 0; ; k++)
+        return replay(file, types);
+    }
+    if(strcmp(mode, "-i") == 0)
+    {
+        CNmeaImporter importer((argc > 3) ? atoi(argv[3]) : 0);
+        std::vector<CGpsFix> fixes;
+        try
         {
-            char buf[500];
-            if(!fgets(buf, sizeof(buf), fp))
-            {
-                break;
-            }
-            // Parse NMEA sentence
-            std::string file_line(buf);
-            if(GPS.parseSentence(file_line))
-            {
-        
-                pos_val = GPS.getBearing(data_present);
-                std::cout << "Position = " << pos_val << (data_present ? (" - " + file_line) : " - error: old data") << std::endl;
-            }
-#if 0
-            else
-            {
-                std::cout << "Parse failed -- line = " << file_line << std::endl;
-            }
-#endif
+            importer.import(name ? name : "gps.log", fixes);
         }
-        if(fp)
+        catch(const std::exception & e)
         {
-            fclose(fp);
+            std::cout << "File open error -- " << e.what() << std::endl;
+            return 1;
+        }
+        const CNmeaImporter::Stats & s = importer.stats();
+        std::cout << s.fixes << " fixes from " << s.sentences << " sentences in " << s.seconds << " s, "
+                  << importer.threads() << " threads, " << s.sentences / s.seconds << " sentences/s, "
+                  << s.bytes / s.seconds / 1e6 << " MB/s" << std::endl;
+        if(!fixes.empty())
+        {
+            const CGpsFix & last = fixes.back();
+            std::cout << "Last position = " << last.latitude << ", " << last.longitude << std::endl;
         }
         return 0;
     }
+    if(strcmp(mode, "-p") == 0)
+    {
+        CFdStream pipe(STDIN_FILENO);
+        if(name && strcmp(name, "-") != 0 && !pipe.open(name))
+        {
+            perror("open");
+            return 1;
+        }
+        return replay(pipe, types);
+    }
+    if(strcmp(mode, "-s") == 0)
+    {
+        CSocketStream sock;
+        try
+        {
+            sock.open(name ? name : "");
+        }
+        catch(const std::exception & e)
+        {
+            std::cout << "Socket connect error -- " << e.what() << std::endl;
+            return 1;
+        }
+        return replay(sock, types);
+    }
     // ==================
     // open serial port
     // ==================
@@ -95,6 +155,9 @@ int main(int argc, char* argv[])
     // open GPS
     // ==================
     CGps GPS(ser_port);
+    // read all pending sentences every poll
+    const int DRAIN_BUDGET = (argc > 3) ? atoi(argv[3]) : 0; // msec
+    GPS.setDrainBudget(DRAIN_BUDGET);
     int err;
     if( (err = GPS.Init()) )
     {
@@ -116,6 +179,11 @@ int main(int argc, char* argv[])
 
             pos_val = GPS.getBearing(data_present);
             std::cout << "Position=" << pos_val << (data_present ? "" : " - error: old data") << std::endl;
+            if(DRAIN_BUDGET > 0)
+            {
+                std::cout << "Sentences processed=" << GPS.getLastDrain().processed
+                          << " dropped=" << GPS.getLastDrain().dropped << std::endl;
+            }
         }
         else
         {
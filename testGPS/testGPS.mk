@@ -2,7 +2,7 @@ TARGET := TestGPS
 
 SRC_CXXFLAGS := -g -O0 -Wall -pipe -DDEBUGMODE
 TGT_LDFLAGS := -L${TARGET_DIR}
-TGT_LDLIBS  := -lboost_system
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono -lboost_iostreams
 TGT_PREREQS := 
 
 SOURCES := testGPS.cpp ../CSerialPort.cpp
@@ -2,7 +2,7 @@ TARGET := TestObd
 
 SRC_CXXFLAGS := -g -O0 -Wall -pipe -DDEBUGMODE
 TGT_LDFLAGS := -L${TARGET_DIR}
-TGT_LDLIBS  := -lboost_system -lboost_thread
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono
 TGT_PREREQS := 
 
 SOURCES := testObd.cpp ../CSerialPort.cpp  ../PidScanner.cpp
@@ -0,0 +1,141 @@
+/// Test the time indexed fix track.
+/// Checks ring wrap-around, lookups by time, range queries and
+/// interpolation, including course and longitude wrapping, then feeds a
+/// recorded NMEA stream through CGps to check one entry per epoch.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <iostream>
+
+#include "CGps.h"
+#include "CGpsTrack.h"
+
+static int failures = 0;
+
+// --------------------------------------------
+// Report a check
+static void check(bool ok, const std::string & name)
+{
+    std::cout << (ok ? "PASS " : "FAIL ") << name << std::endl;
+    if(!ok)
+    {
+        failures++;
+    }
+}
+
+typedef CGpsTrack::TimePoint TimePoint;
+
+// Time point k * 100 ms after the start of the test
+static TimePoint at(const TimePoint & start, int k)
+{
+    return start + boost::chrono::milliseconds(100 * k);
+}
+
+// --------------------------------------------
+// Track with fixes k = 0..count-1, latitude k, longitude 179.9 + k / 10
+static void fill(CGpsTrack & track, const TimePoint & start, int count)
+{
+    CGpsFix fix;
+    for(int k = 0; k < count; k++)
+    {
+        fix.latitude = k;
+        fix.longitude = (k < 2) ? 179.9 + k * 0.1 : -180 + (k - 1) * 0.1;
+        fix.altitude = 100 + k;
+        fix.speed = 10;
+        fix.course = (k % 2) ? 10 : 350;
+        track.push(at(start, k), fix);
+    }
+}
+
+// --------------------------------------------
+static void testRing()
+{
+    TimePoint start = CGpsTrack::Clock::now();
+    CGpsTrack track(100);
+    check(track.capacity() == 128, "capacity rounded to a power of 2");
+
+    fill(track, start, 300);
+    check(track.size() == 128 && track.at(0).latitude == 300 - 128 && track.at(127).latitude == 299,
+          "oldest fixes overwritten");
+
+    CGpsFix fix;
+    check(!track.push(at(start, 298), fix), "older stamp rejected");
+
+    check(track.lowerBound(at(start, 250)) == 250 - (300 - 128) && track.lowerBound(at(start, 400)) == 128 &&
+          track.lowerBound(start) == 0, "lower bound by time");
+
+    size_t first;
+    size_t n = track.range(at(start, 240), at(start, 250), first);
+    check(n == 10 && track.at(first).latitude == 240, "fixes in a time range");
+
+    CGpsTrack::Point p;
+    check(track.interpolate(at(start, 260) + boost::chrono::milliseconds(25), p) &&
+          fabs(p.latitude - 260.25) < 1e-9 && fabs(p.altitude - 360.25) < 1e-9, "interpolation");
+    check(!track.interpolate(at(start, 100), p) && !track.interpolate(at(start, 300), p),
+          "no interpolation outside the track");
+}
+
+// --------------------------------------------
+static void testWrap()
+{
+    TimePoint start = CGpsTrack::Clock::now();
+    CGpsTrack track(8);
+    fill(track, start, 3);
+
+    CGpsTrack::Point p;
+    // course 350 -> 10 and longitude 180 -> -179.9 go the short way
+    check(track.interpolate(at(start, 0) + boost::chrono::milliseconds(75), p) &&
+          fabs(p.course - 5) < 1e-4 && fabs(p.longitude - 179.975) < 1e-9, "course wraps through north");
+    check(track.interpolate(at(start, 1) + boost::chrono::milliseconds(50), p) &&
+          fabs(p.longitude + 179.95) < 1e-9, "longitude wraps at 180");
+}
+
+// --------------------------------------------
+// Append "$body*hh"
+static std::string sentence(const char *body)
+{
+    unsigned char crc = 0;
+    for(const char *p = body; *p; p++)
+    {
+        crc ^= static_cast<unsigned char>(*p);
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf), "$%s*%02X", body, crc);
+    return buf;
+}
+
+static void testGps()
+{
+    CGps gps;
+    gps.enableTrack(16);
+    char body[128];
+    for(int k = 0; k < 20; k++)
+    {
+        snprintf(body, sizeof(body), "GPRMC,1200%02d.00,A,5618.%05d,N,04404.72176,E,12.5,45.0,010120,,", k, k * 100);
+        gps.parseSentence(sentence(body));
+        snprintf(body, sizeof(body), "GPGGA,1200%02d.00,5618.%05d,N,04404.72176,E,1,07,1.21,%d.0,M,6.2,M,,", k, k * 100, 200 + k);
+        gps.parseSentence(sentence(body));
+    }
+    const CGpsTrack & track = gps.getTrack();
+    check(track.size() == 16, "one entry per epoch");
+    check(track.at(15).altitude == 219 && fabs(track.at(15).latitude - (56 + 18.019 / 60)) < 1e-9,
+          "epoch entry updated by its later sentences");
+
+    CGpsTrack::Point p;
+    check(gps.getTrack().ago(boost::chrono::seconds(0), p) == false &&
+          !gps.getTrack().ago(boost::chrono::hours(1), p), "ago() outside the track");
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    testRing();
+    testWrap();
+    testGps();
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures ? 1 : 0;
+}
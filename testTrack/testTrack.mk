@@ -0,0 +1,10 @@
+TARGET := TestTrack
+
+SRC_CXXFLAGS := -g -O0 -Wall -pipe
+TGT_LDFLAGS := -L${TARGET_DIR}
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono
+TGT_PREREQS := 
+
+SOURCES := testTrack.cpp ../CSerialPort.cpp
+
+SRC_INCDIRS := ..
@@ -0,0 +1,384 @@
+/// Test fixed-size reads of CUart on a pseudo-terminal loopback.
+/// Checks that read() and readString() return exactly the requested bytes
+/// under fragmented input, use data buffered by line reads, keep working
+/// after a timeout, that a filtered line read keeps its timeout, that a
+/// read timeout leaves writes in progress alone, and that lines carry
+/// their arrival time. No hardware needed.
+
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "CSerialPort.h"
+#include "CPtyLoopback.h"
+
+static int failures = 0;
+
+// --------------------------------------------
+// Report a check
+static void check(bool ok, const std::string & name)
+{
+    std::cout << (ok ? "PASS " : "FAIL ") << name << std::endl;
+    if(!ok)
+    {
+        failures++;
+    }
+}
+
+// Test data byte at stream position
+static char patternByte(size_t pos)
+{
+    return static_cast<char>((pos * 7 + pos / 251) & 0xFF);
+}
+
+// --------------------------------------------
+// Inject total bytes of the pattern in random fragments of 1..max_fragment
+// bytes with random pauses
+static void injectFragments(CPtyLoopback * pty, size_t total, size_t max_fragment, unsigned seed)
+{
+    std::vector<char> buf(max_fragment);
+    for(size_t pos = 0; pos < total; )
+    {
+        size_t len = 1 + rand_r(&seed) % max_fragment;
+        len = std::min(len, total - pos);
+        for(size_t i = 0; i < len; i++)
+        {
+            buf[i] = patternByte(pos + i);
+        }
+        pty->inject(&buf[0], len);
+        pos += len;
+        if(rand_r(&seed) % 4 == 0)
+        {
+            usleep(rand_r(&seed) % 500);
+        }
+    }
+}
+
+// --------------------------------------------
+// Read the fragmented stream with fixed reads of random size
+static void testFragmented(bool reader)
+{
+    const size_t TOTAL = 1 << 20;
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::seconds(5));
+    if(reader)
+    {
+        port.startReader();
+    }
+
+    boost::thread feeder(boost::bind(injectFragments, &pty, TOTAL, 700, 1));
+
+    unsigned seed = 2;
+    std::vector<char> buf(1024);
+    size_t pos = 0, reads = 0;
+    bool ok = true;
+    while(ok && pos < TOTAL)
+    {
+        size_t len = std::min<size_t>(1 + rand_r(&seed) % buf.size(), TOTAL - pos);
+        ok = port.read(&buf[0], len) == CUart::resultSuccess;
+        for(size_t i = 0; ok && i < len; i++)
+        {
+            ok = buf[i] == patternByte(pos + i);
+        }
+        pos += len;
+        reads++;
+    }
+    feeder.join();
+    check(ok && pos == TOTAL, std::string("fragmented input, exact bytes") + (reader ? ", reader" : ""));
+}
+
+// --------------------------------------------
+// read() continues a stream partly buffered by readStringUntil()
+static void testReadahead(bool reader)
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::seconds(2));
+    if(reader)
+    {
+        port.startReader();
+    }
+
+    // line and the beginning of a binary block arrive together
+    pty.inject(std::string("$HDR,8\r\n\x01\x02\x03", 11));
+    std::string line;
+    bool ok = port.readStringUntil(line, "\r\n") == CUart::resultSuccess && line == "$HDR,8";
+
+    // rest of the block comes later
+    boost::thread late(boost::bind(&CPtyLoopback::inject, &pty, std::string("\x04\x05\x06\x07\x08TAIL", 9)));
+    char block[8];
+    ok = ok && port.read(block, sizeof(block)) == CUart::resultSuccess &&
+         std::string(block, sizeof(block)) == std::string("\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+    late.join();
+
+    char tail[4];
+    ok = ok && port.read(tail, sizeof(tail)) == CUart::resultSuccess && std::string(tail, 4) == "TAIL";
+    check(ok, std::string("readahead drained before reading") + (reader ? ", reader" : ""));
+}
+
+// --------------------------------------------
+// A timed out read does not affect the next one, partial data is kept
+static void testTimeout()
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::milliseconds(50));
+
+    char buf[4];
+    check(port.read(buf, sizeof(buf)) == CUart::resultTimeoutExpired, "timeout without data");
+
+    pty.inject("ABCD");
+    check(port.read(buf, sizeof(buf)) == CUart::resultSuccess && std::string(buf, 4) == "ABCD",
+          "read after timeout");
+
+    pty.inject("EF");
+    bool ok = port.read(buf, sizeof(buf)) == CUart::resultTimeoutExpired;
+    pty.inject("GH");
+    ok = ok && port.read(buf, sizeof(buf)) == CUart::resultSuccess && std::string(buf, 4) == "EFGH";
+    check(ok, "partial data kept after timeout");
+
+    pty.inject("line\r\n");
+    std::string line;
+    check(port.readStringUntil(line, "\r\n") == CUart::resultSuccess && line == "line",
+          "line read after timeout");
+}
+
+// --------------------------------------------
+// Inject data after a delay
+static void injectLater(CPtyLoopback * pty, int ms, const std::string & data)
+{
+    boost::this_thread::sleep(boost::posix_time::milliseconds(ms));
+    pty->inject(data);
+}
+
+// The timeout of a filtered line read covers the rejected lines as well
+class WantedLine : public CByteStream::LineFilter
+{
+public:
+    virtual bool accept(const char *data, size_t size) const { return size > 0 && data[0] == 'W'; }
+};
+
+static void testFilteredTimeout(bool reader)
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::milliseconds(200));
+    if(reader)
+    {
+        port.startReader();
+    }
+
+    // a rejected line late in the timeout does not restart it
+    boost::thread late(boost::bind(injectLater, &pty, 150, std::string("X\r\n")));
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    std::string line;
+    size_t skipped = 0;
+    bool ok = port.readFilteredLine(line, "\r\n", WantedLine(), skipped) == CUart::resultTimeoutExpired;
+    long ms = (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds();
+    late.join();
+    check(ok && skipped == 1 && ms < 300, std::string("filtered line timeout covers the call") + (reader ? ", reader" : ""));
+}
+
+// --------------------------------------------
+// A timed out asynchronous read does not fail the writes in progress
+static int writeResult = -1, readResult = -1;
+static size_t writeSize = 0;
+
+static void onWrite(int result, size_t size)
+{
+    writeResult = result;
+    writeSize = size;
+}
+
+static void onRead(int result, const std::string &)
+{
+    readResult = result;
+}
+
+static void testAsyncReadTimeout()
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::milliseconds(50));
+
+    // more than the pty buffer, the write waits for the other end
+    std::string block(100000, 'x');
+    port.asyncWriteString(block, onWrite);
+    port.asyncReadStringUntil("\r\n", onRead);
+    boost::thread io(boost::bind(&boost::asio::io_service::run, &port.getIoService()));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    char buf[4096];
+    size_t total = 0, n;
+    while((n = pty.receive(buf, sizeof(buf), 200)) > 0)
+    {
+        total += n;
+    }
+    io.join();
+    check(readResult == CUart::resultTimeoutExpired && writeResult == CUart::resultSuccess &&
+          writeSize == block.size() && total == block.size(), "read timeout keeps the write going");
+}
+
+// --------------------------------------------
+// A flush with nothing queued completes through the io_service as well
+static void testAsyncFlushEmpty()
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    writeResult = -1;
+    port.asyncFlush(onWrite);
+    bool deferred = writeResult == -1;
+    port.getIoService().run();
+    check(deferred && writeResult == CUart::resultSuccess && writeSize == 0, "empty flush handler not called inline");
+}
+
+// --------------------------------------------
+// Switching the low-latency profile off restores the termios it changed
+static void testLowLatencyRestore()
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    int fd = open(pty.getSlaveName().c_str(), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 5;
+    tcsetattr(fd, TCSANOW, &tio);
+
+    port.setLowLatency(true);
+    tcgetattr(fd, &tio);
+    bool ok = tio.c_cc[VMIN] == 1 && tio.c_cc[VTIME] == 0;
+    port.setLowLatency(false);
+    tcgetattr(fd, &tio);
+    ok = ok && tio.c_cc[VMIN] == 0 && tio.c_cc[VTIME] == 5;
+    close(fd);
+    check(ok, "low-latency profile undone");
+}
+
+// --------------------------------------------
+// A timed out read keeps the readahead of a line read as well
+static void testReadaheadTimeout(bool reader)
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::milliseconds(50));
+    if(reader)
+    {
+        port.startReader();
+    }
+
+    pty.inject("L\r\nAB");
+    std::string line;
+    bool ok = port.readStringUntil(line, "\r\n") == CUart::resultSuccess && line == "L";
+
+    char buf[4];
+    ok = ok && port.read(buf, sizeof(buf)) == CUart::resultTimeoutExpired;
+    pty.inject("C");
+    ok = ok && port.read(buf, sizeof(buf)) == CUart::resultTimeoutExpired;
+    pty.inject("D");
+    ok = ok && port.read(buf, sizeof(buf)) == CUart::resultSuccess && std::string(buf, 4) == "ABCD";
+    check(ok, std::string("readahead kept after timeout") + (reader ? ", reader" : ""));
+}
+
+// --------------------------------------------
+// readString() reads capacity() bytes into the same storage every time
+static void testReadString()
+{
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::seconds(2));
+
+    std::string s;
+    s.reserve(64);
+    const size_t cap = s.capacity();
+    std::string expect;
+    for(size_t i = 0; i < 3 * cap; i++)
+    {
+        expect += patternByte(i);
+    }
+    boost::thread feeder(boost::bind(injectFragments, &pty, expect.size(), 5, 3));
+
+    bool ok = true;
+    const char *storage = NULL;
+    for(size_t i = 0; ok && i < 3; i++)
+    {
+        ok = port.readString(s) == CUart::resultSuccess && s.size() == cap &&
+             s == expect.substr(i * cap, cap);
+        if(i == 0)
+        {
+            storage = s.data();
+        }
+        ok = ok && s.data() == storage;
+    }
+    feeder.join();
+    check(ok, "readString exact bytes, storage reused");
+}
+
+// --------------------------------------------
+// Lines are stamped when they arrive, not when they are read
+static void testReceiveTime(bool reader)
+{
+    typedef CByteStream::Clock Clock;
+    CPtyLoopback pty;
+    CUart port(pty.getSlaveName(), 115200);
+    port.setTimeout(boost::posix_time::seconds(2));
+    std::string line;
+    bool ok;
+    if(reader)
+    {
+        // the reader stamps each chunk, the lines wait in the ring
+        port.startReader();
+        pty.inject("A\r\n");
+        boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        pty.inject("B\r\n");
+        boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        ok = port.readStringUntil(line, "\r\n") == CUart::resultSuccess && line == "A";
+        Clock::time_point a = port.getReceiveTime();
+        ok = ok && port.readStringUntil(line, "\r\n") == CUart::resultSuccess;
+        Clock::time_point b = port.getReceiveTime();
+        ok = ok && b - a >= boost::chrono::milliseconds(40) &&
+             Clock::now() - b >= boost::chrono::milliseconds(40);
+    }
+    else
+    {
+        // the second line was received by the read of the first one
+        pty.inject("A\r\nB\r\n");
+        ok = port.readStringUntil(line, "\r\n") == CUart::resultSuccess;
+        Clock::time_point a = port.getReceiveTime();
+        boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        ok = ok && port.readStringUntil(line, "\r\n") == CUart::resultSuccess &&
+             port.getReceiveTime() == a && a != Clock::time_point();
+    }
+    check(ok, std::string("receive time of lines") + (reader ? ", reader" : ""));
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    testFragmented(false);
+    testFragmented(true);
+    testReadahead(false);
+    testReadahead(true);
+    testTimeout();
+    testReadaheadTimeout(false);
+    testReadaheadTimeout(true);
+    testFilteredTimeout(false);
+    testFilteredTimeout(true);
+    testAsyncReadTimeout();
+    testAsyncFlushEmpty();
+    testLowLatencyRestore();
+    testReadString();
+    testReceiveTime(false);
+    testReceiveTime(true);
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,10 @@
+TARGET := TestUart
+
+SRC_CXXFLAGS := -g -O0 -Wall -pipe
+TGT_LDFLAGS := -L${TARGET_DIR}
+TGT_LDLIBS  := -lboost_system -lboost_thread -lboost_chrono -lutil
+TGT_PREREQS := 
+
+SOURCES := testUart.cpp ../CSerialPort.cpp
+
+SRC_INCDIRS := ..
@@ -0,0 +1,130 @@
+/// Test UBX support of CGps on a recorded receiver stream.
+/// navpvt.ubx holds the output of a receiver being switched to UBX: NMEA
+/// sentences, the acknowledges of CFG-PRT, CFG-MSG and CFG-RATE, then
+/// 10 Hz NAV-PVT messages mixed with a corrupted frame, line noise, an
+/// unrelated NAV message, a corrupted NAV-STATUS right before epoch 7 and
+/// a final epoch without fix. The commands CGps sends are checked against
+/// their published byte strings.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "CGps.h"
+#include "CMappedFileStream.h"
+
+static int failures = 0;
+
+// --------------------------------------------
+// Report a check
+static void check(bool ok, const std::string & name)
+{
+    std::cout << (ok ? "PASS " : "FAIL ") << name << std::endl;
+    if(!ok)
+    {
+        failures++;
+    }
+}
+
+// Frame as a hex string "B5 62 ..."
+static std::string hex(const std::string & frame)
+{
+    std::string out;
+    char buf[4];
+    for(size_t i = 0; i < frame.size(); i++)
+    {
+        snprintf(buf, sizeof(buf), i ? " %02X" : "%02X", static_cast<unsigned char>(frame[i]));
+        out += buf;
+    }
+    return out;
+}
+
+// --------------------------------------------
+// Commands against known good frames
+static void testCommands()
+{
+    check(hex(CUbx::cfgRate(100)) == "B5 62 06 08 06 00 64 00 01 00 01 00 7A 12", "CFG-RATE 10 Hz");
+    check(hex(CUbx::cfgRate(200)) == "B5 62 06 08 06 00 C8 00 01 00 01 00 DE 6A", "CFG-RATE 5 Hz");
+    check(hex(CUbx::cfgMessage(CUbx::CLASS_NAV, CUbx::NAV_PVT, 1)) == "B5 62 06 01 03 00 01 07 01 13 51",
+          "CFG-MSG NAV-PVT on");
+    std::string prt = CUbx::cfgPort(38400, CUbx::PROTO_UBX | CUbx::PROTO_NMEA, CUbx::PROTO_UBX);
+    check(prt.size() == 28 && hex(prt.substr(0, 6)) == "B5 62 06 00 14 00" &&
+          hex(prt.substr(14, 8)) == "00 96 00 00 03 00 01 00", "CFG-PRT UART1 38400, UBX out");
+}
+
+// --------------------------------------------
+// Decode the recording
+static void testRecording(const char *file_name)
+{
+    CMappedFileStream file;
+    try
+    {
+        file.open(file_name);
+    }
+    catch(const std::exception & e)
+    {
+        check(false, std::string("open ") + file_name + " -- " + e.what());
+        return;
+    }
+    CGps gps(file);
+    // commands go nowhere, the acknowledges are in the recording
+    check(gps.enableUbx(38400, 10) == 0, "configuration acknowledged");
+
+    std::vector<CGpsFix> fixes;
+    int polls = 0, misses = 0;
+    while(!file.eof() && polls++ < 100)
+    {
+        if(gps.pollBearing())
+        {
+            fixes.push_back(gps.getFix());
+        }
+        else
+        {
+            misses++;
+        }
+    }
+    // epoch 4 has a bad checksum, the last one no fix
+    static const int epochs[] = { 0, 1, 2, 3, 5, 6, 7, 8, 9 };
+    const size_t count = sizeof(epochs) / sizeof(epochs[0]);
+    check(fixes.size() == count, "NAV-PVT frames decoded, bad frame and noise skipped");
+    // only the no fix epoch, a bad frame does not end the poll
+    check(misses == 1, "NAV-PVT after a corrupted frame decoded in the same poll");
+
+    bool position = true, time = true, other = true;
+    for(size_t i = 0; i < fixes.size() && i < count; i++)
+    {
+        const CGpsFix & f = fixes[i];
+        int k = epochs[i];
+        position = position && f.latitude == (563045488 + k * 10) * 1e-7 &&
+                   f.longitude == (440786960 + k * 17) * 1e-7 &&
+                   fabs(f.altitude - (250.100 + k * 0.001)) < 1e-9;
+        boost::uint32_t ms = (k == 9) ? (12 * 3600 + 34 * 60 + 57) * 1000 : (12 * 3600 + 34 * 60 + 56) * 1000 + k * 100;
+        time = time && f.time == ms && f.year == 2024 && f.month == 5 && f.day == 17;
+        other = other && f.valid && f.quality == 1 && f.mode == 3 && f.satellites == 12 &&
+                fabs(f.pdop - 1.21) < 1e-5 && fabs(f.speed - 6.430 * 3600 / 1852) < 1e-4 &&
+                fabs(f.course - 45.0) < 1e-5 && fabs(f.latError - 1.5) < 1e-6 && fabs(f.altError - 2.5) < 1e-6;
+    }
+    check(position, "position, 1e-7 degree resolution kept");
+    check(time, "time and date, negative nanoseconds");
+    check(other, "status, satellites, DOP, speed, course, accuracy");
+
+    const CGpsFix & last = gps.getFix();
+    check(!last.valid && last.mode == 1 && last.latitude == fixes.back().latitude, "no fix epoch keeps position");
+
+    bool present;
+    check(gps.getBearing(present) == "56 18 16 N, 044 04 43 E", "bearing string");
+}
+
+// --------------------------------------------
+// Main program
+int main(int argc, char* argv[])
+{
+    testCommands();
+    testRecording((argc > 1) ? argv[1] : "navpvt.ubx");
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures ? 1 : 0;
+}